@@ -19,6 +19,19 @@ interval aabb::traverse(ray const &r) const {
     // @perf for nontemporal loads we must have the ray aligned at a 32 byte
     // boundary.
 
+#ifdef RTWK_SINGLE_PRECISION
+    // @cutnpaste from below, with 4x float's.
+    auto adinvs = _mm_loadu_ps(r.dir.e);
+    auto origs = _mm_loadu_ps(r.orig.e);
+    auto mins = (__m128)_mm_stream_load_si128((__m128i *)&min.e);
+    auto maxes = (__m128)_mm_stream_load_si128((__m128i *)&max.e);
+
+    auto t0s = (mins - origs) / adinvs;
+    auto t1s = (maxes - origs) / adinvs;
+
+    auto tmins = _mm_min_ps(t0s, t1s);
+    auto tmaxs = _mm_max_ps(t0s, t1s);
+#else
     auto adinvs = _mm256_loadu_pd((double *)&r.dir.e);
     auto origs = _mm256_loadu_pd((double *)&r.orig.e);
     // @perf 'mins' has in its leftmost slot (register order) the first for
@@ -32,6 +45,7 @@ interval aabb::traverse(ray const &r) const {
 
     auto tmins = _mm256_min_pd(t0s, t1s);
     auto tmaxs = _mm256_max_pd(t0s, t1s);
+#endif
 
     // NOTE: @perf The compiler seems to be generating smarter code than I am
     // for this last comparison loop step (minsd, maxsd three times :P).
@@ -42,12 +56,12 @@ interval aabb::traverse(ray const &r) const {
     // <garbo> <tx[0]> <tx[2]> <tx[1]> <- ideal (I don't know if I can have it)
     // <garbo> <0/2>   <1/2>   <0/1>
     // minsd, maxsd twice?
-    auto tmin_array = (double *)&tmins;
-    auto tmaxs_array = (double *)&tmaxs;
+    auto tmin_array = (real *)&tmins;
+    auto tmaxs_array = (real *)&tmaxs;
     interval ray_t{tmin_array[0], tmaxs_array[0]};
     for (int axis = 1; axis < 3; ++axis) {
-        auto t0 = ((double *)&tmins)[axis];
-        auto t1 = ((double *)&tmaxs)[axis];
+        auto t0 = ((real *)&tmins)[axis];
+        auto t1 = ((real *)&tmaxs)[axis];
 
         if (t0 > ray_t.min) ray_t.min = t0;
         if (t1 < ray_t.max) ray_t.max = t1;
@@ -56,19 +70,11 @@ interval aabb::traverse(ray const &r) const {
     return ray_t;
 }
 
-double aabb::hit(ray const &r) const {
+real aabb::hit(ray const &r) const {
     auto intv = traverse(r);
-    auto ok = !intv.isEmpty();
-    // @perf ok is just `intv.min < intv.max`, so -sign(intv.min - intv.max)
-    // should be good. -sign because we want intv.min == intv.max to yield -1,
-    // sign(0) = 0 -> -sign(0) = 1. Since we swap the sign we also have to swap
-    // the subtraction.
-    // If `traverse` returned bool64 we could negate the bool64 to get 11111...
-    // and then use `copysign` to copy the sign over to the result. We can also
-    // get "bool64" by multiplying/shifting.
-    auto res = intv.min;
-    res = ok ? res : -res;
-    return res;
+    // A miss must be below any minRayDist. Negating intv.min isn't enough:
+    // an empty slab interval can have a negative min.
+    return intv.isEmpty() ? -infinity : intv.min;
 }
 
 vec3 aabb::getNormal(point3 intersection) const {
@@ -76,8 +82,8 @@ vec3 aabb::getNormal(point3 intersection) const {
     for (int axis = 0; axis < 3; ++axis) {
         auto intv = axis_interval(axis);
 
-        if (std::abs(intersection[axis] - intv.min) > 1e-8 &&
-            std::abs(intersection[axis] - intv.max) > 1e-8) {
+        if (std::abs(intersection[axis] - intv.min) > surface_epsilon &&
+            std::abs(intersection[axis] - intv.max) > surface_epsilon) {
             continue;
         }
 
@@ -100,10 +106,10 @@ uvs aabb::getUVs(point3 intersection) const {
         auto uintv = axis_interval(uaxis);
         auto vintv = axis_interval(vaxis);
 
-        double beta_distance;
-        if (std::abs(intersection[axis] - intv.min) < 1e-8) {
+        real beta_distance;
+        if (std::abs(intersection[axis] - intv.min) < surface_epsilon) {
             beta_distance = vintv.max;
-        } else if (std::abs(intersection[axis] - intv.max) < 1e-8) {
+        } else if (std::abs(intersection[axis] - intv.max) < surface_epsilon) {
             beta_distance = vintv.min;
         } else {
             continue;
@@ -18,7 +18,12 @@
 #include "vec3.h"
 
 struct aabb {
+#ifdef RTWK_SINGLE_PRECISION
+    // traverse loads each corner as 4x float, which only needs 16 bytes.
+    vec3 min alignas(16), max alignas(16);
+#else
     vec3 min alignas(32), max alignas(32);
+#endif
 
     // The default AABB is empty, since intervals are empty by default.
     constexpr aabb() = default;
@@ -58,17 +63,22 @@ struct aabb {
         return interval{min[n], max[n]};
     }
 
-    double hit(ray const &r) const;
+    real hit(ray const &r) const;
     // Helper method to traverse using an already existing `ray_t` and modifying
     // it. It clobbers `ray_t`.
     interval traverse(ray const &r) const;
     uvs getUVs(point3 intersection) const;
     point3 getNormal(point3 intersection) const;
 
+    constexpr real surface_area() const {
+        auto d = max - min;
+        return 2 * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+    }
+
     constexpr int longest_axis() const {
         // Returns the index of the longest axis of the bounding box.
 
-        double xsizes[3];
+        real xsizes[3];
         for (int axis = 0; axis < 3; ++axis) {
             xsizes[axis] = max[axis] - min[axis];
         }
@@ -83,7 +93,7 @@ struct aabb {
         // Adjust the AABB so that no side is narrower than some delta, padding
         // if necessary.
 
-        constexpr double delta = 0.0001;
+        constexpr real delta = 0.0001;
 
         for (int axis = 0; axis < 3; ++axis) {
             auto size = max[axis] - min[axis];
@@ -95,6 +105,9 @@ struct aabb {
     }
 };
 
+// Two corners padded to the vector loads of traverse.
+static_assert(sizeof(aabb) == 8 * sizeof(real));
+
 static constexpr aabb empty_aabb =
     aabb{empty_interval, empty_interval, empty_interval};
 static constexpr aabb universe_aabb =
@@ -0,0 +1,123 @@
+// rt-bench: renders every built-in scene with fixed settings and reports
+// the work done and the time it took as JSON, to compare commits.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <print>
+#include <string_view>
+#include <utility>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "random.h"
+#include "renderer.h"
+#include "scenes.h"
+#include "stats.h"
+#include "timer.h"
+
+#ifndef RTWK_STATS
+#error "rt-bench needs the counters, build it with RTWK_STATS"
+#endif
+
+// Same for every scene, so that the scenes with random objects are the same
+// on every run.
+static constexpr unsigned int sceneSeed = 1;
+
+static double ms(std::chrono::nanoseconds d) { return d.count() * 1e-6; }
+
+int main(int argc, char **argv) {
+    int width = 200, spp = 16, depth = 10;
+    char const *outPath = "bench.json";
+    std::string_view only;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        bool const hasValue = i + 1 < argc;
+        if (arg == "--width" && hasValue) {
+            width = std::atoi(argv[++i]);
+        } else if (arg == "--spp" && hasValue) {
+            spp = std::atoi(argv[++i]);
+        } else if (arg == "--depth" && hasValue) {
+            depth = std::atoi(argv[++i]);
+        } else if (arg == "--out" && hasValue) {
+            outPath = argv[++i];
+        } else if (arg == "--scene" && hasValue) {
+            only = argv[++i];
+        } else {
+            std::println(stderr,
+                         "usage: rt-bench [--width <n>] [--spp <n>] "
+                         "[--depth <n>] [--scene <name>] [--out <file>]");
+            return 1;
+        }
+    }
+
+#ifdef _OPENMP
+    auto threads = omp_get_max_threads();
+#else
+    auto threads = 1;
+#endif
+
+    auto *out = std::fopen(outPath, "w");
+    if (!out) {
+        std::println(stderr, "ERROR: Could not create '{}'.", outPath);
+        return 1;
+    }
+    std::println(out, "{{");
+    std::println(out, "  \"precision\": \"{}\",",
+                 sizeof(real) == sizeof(float) ? "float" : "double");
+    std::println(out, "  \"threads\": {},", threads);
+    std::println(out, "  \"image_width\": {},", width);
+    std::println(out, "  \"samples_per_pixel\": {},", spp);
+    std::println(out, "  \"max_depth\": {},", depth);
+    std::print(out, "  \"scenes\": [");
+
+    bool first = true;
+    for (auto const &info : builtin_scenes()) {
+        if (!only.empty() && only != info.name) continue;
+        std::println(stderr, "{}", info.name);
+
+        seed_random(sceneSeed);
+        rtwk::stopwatch build_timer;
+        build_timer.start();
+        auto sc = builtin_scene(info.which);
+        std::chrono::nanoseconds build = build_timer.stop();
+
+        sc.s.image_width = width;
+        sc.s.samples_per_pixel = spp;
+        sc.s.max_depth = depth;
+        stats::take();
+        auto timings = render(std::move(sc.world), sc.s);
+        auto c = stats::take();
+
+        auto seconds = timings.render.count() * 1e-9;
+        auto rays = double(c.rays);
+        std::print(out, "{}\n    {{", first ? "" : ",");
+        std::print(out, "\"name\": \"{}\", ", info.name);
+        std::print(out, "\"build_ms\": {:.3f}, ", ms(build));
+        std::print(out, "\"prepare_ms\": {:.3f}, ", ms(timings.prepare));
+        std::print(out, "\"render_ms\": {:.3f}, ", ms(timings.render));
+        std::print(out, "\"write_ms\": {:.3f}, ", ms(timings.write));
+        std::print(out, "\"primary_rays\": {}, ", c.primaryRays);
+        std::print(out, "\"secondary_rays\": {}, ",
+                   c.rays - std::min(c.rays, c.primaryRays));
+        std::print(out, "\"shadow_rays\": {}, ", c.shadowRays);
+        std::print(out, "\"nodes_visited\": {}, ", c.nodesVisited);
+        std::print(out, "\"primitive_tests\": {}, ", c.primitiveTests);
+        std::print(out, "\"mrays_per_s\": {:.3f}, ", rays / seconds * 1e-6);
+        // wall time, so it goes down with more threads.
+        std::print(out, "\"ns_per_ray\": {:.3f}, ",
+                   rays ? timings.render.count() / rays : 0.0);
+        std::print(out, "\"nodes_per_ray\": {:.3f}, ",
+                   rays ? c.nodesVisited / rays : 0.0);
+        std::print(out, "\"tests_per_ray\": {:.3f}}}",
+                   rays ? c.primitiveTests / rays : 0.0);
+        first = false;
+    }
+
+    std::println(out, "\n  ]");
+    std::println(out, "}}");
+    return std::fclose(out) == 0 ? 0 : 1;
+}
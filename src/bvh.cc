@@ -1,11 +1,14 @@
 #include <bvh.h>
 #include <hittable.h>
 
+#include <algorithm>
+#include <bit>
 #include <cassert>
 #include <tracy/Tracy.hpp>
 #include <utility>
 
 #include "interval.h"
+#include "stats.h"
 #include "trace_colors.h"
 
 namespace bvh {
@@ -18,68 +21,275 @@ namespace bvh {
 // TODO: @perf std::vector uses `new`, which aligns the pointer to the required
 // aligment, according to <https://stackoverflow.com/a/3658666>.
 
-static int addNode(tree_builder &bld, aabb box, bvh_node node) {
-    bld.boxes.emplace_back(std::forward<aabb &&>(box));
-    bld.nodes.emplace_back(node);
-    bld.node_ends.emplace_back(bld.nodes.size());
-    return int(bld.nodes.size() - 1);
+// Output of a (sub)tree build. Node indices in `node_ends` are relative to the
+// first node in the sink, so that subtrees built separately can be spliced
+// after their parent.
+struct subtree {
+    std::vector<int> node_ends;
+    std::vector<aabb> boxes;
+    std::vector<bvh_node> nodes;
+};
+
+template <typename Sink>
+static int addNode(Sink &out, aabb box, bvh_node node) {
+    out.boxes.emplace_back(std::forward<aabb &&>(box));
+    out.nodes.emplace_back(node);
+    out.node_ends.emplace_back(out.nodes.size());
+    return int(out.nodes.size() - 1);
 }
 
-[[clang::noinline]] static int buildBVHNode(tree_builder &bld, int start,
-                                            int end, int depth = 0) {
-    static constexpr int minObjectsInTree = 6;
-    static_assert(minObjectsInTree > 1,
-                  "Min objects in tree must be at least 2, otherwise it will "
-                  "stack overflow");
+// Appends `sub` at the end of `out`, keeping the pre-order layout.
+template <typename Sink>
+static void splice(Sink &out, subtree const &sub) {
+    auto base = int(out.nodes.size());
+    out.boxes.insert(out.boxes.end(), sub.boxes.begin(), sub.boxes.end());
+    out.nodes.insert(out.nodes.end(), sub.nodes.begin(), sub.nodes.end());
+    for (auto end : sub.node_ends) out.node_ends.emplace_back(base + end);
+}
 
-    assert(end > start);
-    // Build the bounding box of the span of source objects.
+static aabb boundsOf(geometry const *geoms, int start, int end) {
     aabb bbox = empty_aabb;
     for (int i = start; i < end; ++i)
-        bbox = aabb(bbox, bld.geoms[i].bounding_box());
-    auto object_span = end - start;
-
-    if (object_span == 1) {
-        return addNode(bld, std::move(bbox), bvh_node{start, 1});
-    }
+        bbox = aabb(bbox, geoms[i].bounding_box());
+    return bbox;
+}
 
+// Partitions [start, end) in two, returning the index of the first object on
+// the right side, or -1 if the range should be kept as a single leaf.
+static int partitionMidpoint(geometry *geoms, int start, int end,
+                             aabb const &bbox) {
     int axis = bbox.longest_axis();
 
     // split in half along longest axis.
     auto partitionPoint = bbox.axis_interval(axis).midPoint();
 
     auto it = std::partition(
-        bld.geoms.data() + start, bld.geoms.data() + end,
+        geoms + start, geoms + end,
         [axis, partitionPoint](geometry const &a) {
             auto a_axis_interval = a.bounding_box().axis_interval(axis);
             return a_axis_interval.midPoint() <= partitionPoint;
         });
 
-    auto midIndex = std::distance(bld.geoms.data(), it);
+    auto midIndex = int(std::distance(geoms, it));
     if (midIndex == start || midIndex == end) {
         // cannot split these objects
-        return addNode(bld, std::move(bbox), bvh_node{start, (end - start)});
+        return -1;
     }
+    return midIndex;
+}
+
+namespace sah {
+// @perf 16 bins is usually enough to get within a few percent of the full
+// sweep, and keeps the bins in L1.
+static constexpr int binCount = 16;
 
-    auto parent = addNode(bld, std::move(bbox), bvh_node{-1, 0});
+// Relative costs of visiting a node and of testing an object. Node visits are
+// mostly a memory fetch (see the latency note in hitBVH), so they aren't much
+// cheaper than testing a sphere or a quad.
+static constexpr real traversalCost = 1.0;
+static constexpr real intersectCost = 1.0;
 
-    buildBVHNode(bld, start, midIndex, depth + 1);
-    buildBVHNode(bld, midIndex, end, depth + 1);
+// Leaves bigger than this are split even if the heuristic says otherwise, so
+// that a bad estimate can't leave us with a linear scan.
+static constexpr int maxLeafObjects = 8;
 
-    bld.nodes[parent].objectIndex = -1;
-    bld.node_ends[parent] = bld.nodes.size();
+struct bin {
+    aabb box = empty_aabb;
+    int count = 0;
+};
+
+struct split {
+    int axis = -1;
+    int bin = -1;
+    real cost = infinity;
+};
+
+static int binIndex(real centroid, interval centroids) {
+    auto b = int(binCount * (centroid - centroids.min) / centroids.size());
+    return std::clamp(b, 0, binCount - 1);
+}
+
+// Finds the cheapest split plane among the bin boundaries of all three axes.
+// The returned cost is relative to the surface area of the parent.
+static split findSplit(geometry const *geoms, int start, int end,
+                       aabb const &centroidBox) {
+    split best;
+    for (int axis = 0; axis < 3; ++axis) {
+        auto centroids = centroidBox.axis_interval(axis);
+        // all centroids are in the same plane, can't split on this axis.
+        if (centroids.size() <= 0) continue;
+
+        bin bins[binCount];
+        for (int i = start; i < end; ++i) {
+            auto box = geoms[i].bounding_box();
+            auto &b = bins[binIndex(box.axis_interval(axis).midPoint(),
+                                    centroids)];
+            b.box = aabb(b.box, box);
+            ++b.count;
+        }
+
+        // Sweep from the right first so that the left sweep can compute the
+        // cost of every split in one pass.
+        real rightAreas[binCount];
+        int rightCounts[binCount];
+        {
+            aabb box = empty_aabb;
+            int count = 0;
+            for (int b = binCount - 1; b > 0; --b) {
+                box = aabb(box, bins[b].box);
+                count += bins[b].count;
+                rightAreas[b] = count ? box.surface_area() : 0;
+                rightCounts[b] = count;
+            }
+        }
+
+        aabb box = empty_aabb;
+        int count = 0;
+        // splitting after bin `b` puts [0, b] on the left.
+        for (int b = 0; b < binCount - 1; ++b) {
+            box = aabb(box, bins[b].box);
+            count += bins[b].count;
+            if (count == 0 || rightCounts[b + 1] == 0) continue;
+            auto cost = box.surface_area() * count +
+                        rightAreas[b + 1] * rightCounts[b + 1];
+            if (cost < best.cost) best = {axis, b, cost};
+        }
+    }
+    return best;
+}
+}  // namespace sah
+
+static int partitionSAH(geometry *geoms, int start, int end,
+                        aabb const &bbox) {
+    aabb centroidBox = empty_aabb;
+    for (int i = start; i < end; ++i) {
+        auto box = geoms[i].bounding_box();
+        auto c = box.min + 0.5 * (box.max - box.min);
+        centroidBox = aabb(centroidBox, aabb(c, c));
+    }
+    auto object_span = end - start;
+
+    auto best = sah::findSplit(geoms, start, end, centroidBox);
+    // every centroid is in the same spot, nothing to split.
+    if (best.axis == -1) return -1;
+
+    auto leafCost = sah::intersectCost * object_span;
+    auto splitCost = sah::traversalCost +
+                     sah::intersectCost * best.cost / bbox.surface_area();
+    if (object_span <= sah::maxLeafObjects && leafCost <= splitCost) return -1;
+
+    auto centroids = centroidBox.axis_interval(best.axis);
+    auto it = std::partition(
+        geoms + start, geoms + end,
+        [axis = best.axis, split = best.bin, centroids](geometry const &a) {
+            auto mid = a.bounding_box().axis_interval(axis).midPoint();
+            return sah::binIndex(mid, centroids) <= split;
+        });
+    auto midIndex = int(std::distance(geoms, it));
+    // findSplit only returns splits with objects on both sides.
+    assert(midIndex != start && midIndex != end);
+    return midIndex;
+}
+
+static int partitionNode(geometry *geoms, int start, int end,
+                         aabb const &bbox, split_method method) {
+    switch (method) {
+        case split_method::midpoint:
+            return partitionMidpoint(geoms, start, end, bbox);
+        case split_method::sah:
+            return partitionSAH(geoms, start, end, bbox);
+    }
+    std::unreachable();
+}
+
+template <typename Sink>
+[[clang::noinline]] static int buildBVHNode(Sink &out, geometry *geoms,
+                                            int start, int end,
+                                            split_method method) {
+    assert(end > start);
+    // Build the bounding box of the span of source objects.
+    aabb bbox = boundsOf(geoms, start, end);
+
+    if (end - start == 1) {
+        return addNode(out, std::move(bbox), bvh_node{start, 1});
+    }
+
+    auto midIndex = partitionNode(geoms, start, end, bbox, method);
+    if (midIndex == -1) {
+        return addNode(out, std::move(bbox), bvh_node{start, (end - start)});
+    }
+
+    auto parent = addNode(out, std::move(bbox), bvh_node{-1, 0});
+
+    buildBVHNode(out, geoms, start, midIndex, method);
+    buildBVHNode(out, geoms, midIndex, end, method);
+
+    out.nodes[parent].objectIndex = -1;
+    out.node_ends[parent] = out.nodes.size();
 
     return parent;
 }
 
+// Ranges smaller than this are built sequentially inside the task that reaches
+// them. Forking smaller tasks costs more than the build itself.
+static constexpr int parallelThreshold = 4096;
+
+// Same as buildBVHNode, but forks both children as OpenMP tasks when the range
+// is big enough. Each task builds into its own subtree, which is then spliced
+// in pre-order after the parent.
+// The ranges of `geoms` that each task partitions are disjoint.
+static void buildParallel(subtree &out, geometry *geoms, int start, int end,
+                          split_method method) {
+    if (end - start < parallelThreshold) {
+        buildBVHNode(out, geoms, start, end, method);
+        return;
+    }
+
+    // @perf the partition step of the upper levels is still serial, and it's
+    // O(n) on each level.
+    aabb bbox = boundsOf(geoms, start, end);
+    auto midIndex = partitionNode(geoms, start, end, bbox, method);
+    if (midIndex == -1) {
+        addNode(out, std::move(bbox), bvh_node{start, (end - start)});
+        return;
+    }
+
+    auto parent = addNode(out, std::move(bbox), bvh_node{-1, 0});
+
+    subtree left, right;
+#pragma omp task shared(left)
+    buildParallel(left, geoms, start, midIndex, method);
+#pragma omp task shared(right)
+    buildParallel(right, geoms, midIndex, end, method);
+#pragma omp taskwait
+
+    splice(out, left);
+    splice(out, right);
+    out.node_ends[parent] = out.nodes.size();
+}
+
 }  // namespace bvh
 
-void bvh::tree_builder::finish(size_t start) noexcept {
-    bvh::buildBVHNode(*this, start, geoms.size());
+void bvh::tree_builder::finish(size_t start, split_method method) noexcept {
+    ZoneScopedN("bvh build");
+    auto end = int(geoms.size());
+    if (end - int(start) < parallelThreshold) {
+        bvh::buildBVHNode(*this, geoms.data(), start, end, method);
+        return;
+    }
+
+    subtree root;
+    auto *data = geoms.data();
+#pragma omp parallel
+#pragma omp single
+    bvh::buildParallel(root, data, start, end, method);
+
+    // node_ends must count the nodes of previous calls to finish().
+    splice(*this, root);
 }
 
-std::pair<geometry_ptr, double> bvh::tree::hitBVH(
-    timed_ray const &r, double closestHit) const noexcept {
+std::pair<geometry_ptr, real> bvh::tree::hitBVH(
+    timed_ray const &r, real closestHit) const noexcept {
     // deactivate this zone for now.
     ZoneNamedN(zone, "bvh_tree hit", filters::treeHit);
     geometry_ptr result = nullptr;
@@ -89,40 +299,99 @@ std::pair<geometry_ptr, double> bvh::tree::hitBVH(
     // Perhaps inlining (or hinting) hitSpan is the answer?
 
     // test all relevant nodes against the ray.
+    walk(boxes, node_ends, nodes, r.r, closestHit, [&](int node) {
+        std::tie(result, closestHit) =
+            arrays->hit(arrays->nodeLeaves[node], r, result, closestHit);
+        return false;
+    });
+
+    return {result, closestHit};
+}
+
+bool bvh::tree::occluded(timed_ray const &r, real const maxT) const noexcept {
+    ZoneNamedN(zone, "bvh_tree occluded", filters::treeHit);
+
+    bool hit = false;
+    walk(boxes, node_ends, nodes, r.r, maxT, [&](int node) {
+        hit = arrays->occluded(arrays->nodeLeaves[node], r, maxT);
+        return hit;
+    });
+    return hit;
+}
+
+// Tests every active lane against a single object, keeping the closest hits.
+static void hitPacketObject(geometry const &g, ray_packet const &p,
+                            int active, bvh::packet_hits &hits) {
+    RTWK_COUNT(primitiveTests, std::popcount(unsigned(active)));
+    alignas(32) real ts[ray_packet::width];
+    if (g.kind == geometry_kind::sphere) {
+        simd::store(ts, g.data.sphere.hit(p));
+    } else {
+        // @perf quads and boxes don't have a packet kernel yet.
+        geometry_ptr ptr = g;
+        for (int i = 0; i < ray_packet::width; ++i) {
+            ts[i] = (active >> i) & 1 ? ptr.hit(p.lane(i)) : 0;
+        }
+    }
 
-    auto tree_end = boxes.size();
+    for (int i = 0; i < ray_packet::width; ++i) {
+        if (!((active >> i) & 1)) continue;
+        if (interval{minRayDist, hits.t[i]}.contains(ts[i])) {
+            hits.t[i] = ts[i];
+            hits.geoms[i] = &g;
+        }
+    }
+}
+
+void bvh::tree::hitPacket(ray_packet const &p,
+                          packet_hits &hits) const noexcept {
+    ZoneNamedN(zone, "bvh_tree packet hit", filters::treeHit);
+
+    auto const ox = simd::load(p.ox);
+    auto const oy = simd::load(p.oy);
+    auto const oz = simd::load(p.oz);
+    auto const one = simd::broadcast(1);
+    auto const idx = one / simd::load(p.dx);
+    auto const idy = one / simd::load(p.dy);
+    auto const idz = one / simd::load(p.dz);
+    auto const tmin = simd::broadcast(minRayDist);
+
+    auto closest = simd::load(hits.t);
+
+    // Same pre-order walk as hitBVH, but a subtree is only skipped when no
+    // lane enters it.
+    auto tree_end = int(boxes.size());
     int node_index = 0;
     while (node_index < tree_end) {
-        auto t = boxes[node_index].traverse(r.r);
-        t.max = std::min(t.max, closestHit);
-        t.min = std::max(t.min, minRayDist);
-        if (t.isEmpty()) {
-            if (node_ends[node_index] <= node_index) std::unreachable();
+        RTWK_COUNT(nodesVisited, 1);
+        auto const &box = boxes[node_index];
+        auto tx0 = (simd::broadcast(box.min.x()) - ox) * idx;
+        auto tx1 = (simd::broadcast(box.max.x()) - ox) * idx;
+        auto ty0 = (simd::broadcast(box.min.y()) - oy) * idy;
+        auto ty1 = (simd::broadcast(box.max.y()) - oy) * idy;
+        auto tz0 = (simd::broadcast(box.min.z()) - oz) * idz;
+        auto tz1 = (simd::broadcast(box.max.z()) - oz) * idz;
+
+        auto tnear =
+            simd::max(simd::max(simd::min(tx0, tx1), simd::min(ty0, ty1)),
+                      simd::max(simd::min(tz0, tz1), tmin));
+        auto tfar =
+            simd::min(simd::min(simd::max(tx0, tx1), simd::max(ty0, ty1)),
+                      simd::min(simd::max(tz0, tz1), closest));
+
+        auto active = simd::bits(simd::less_eq(tnear, tfar)) & p.active;
+        if (!active) {
             node_index = node_ends[node_index];
             continue;
         }
-        t.max = std::min(t.max, closestHit);
 
         auto const n = nodes[node_index];
-
         if (n.objectIndex != -1) {
-            auto span = std::span{geoms + n.objectIndex, size_t(n.objectCount)};
-            std::tie(result, closestHit) = hitSpan(span, r, result, closestHit);
+            for (int i = 0; i < n.objectCount; ++i) {
+                hitPacketObject(geoms[n.objectIndex + i], p, active, hits);
+            }
+            closest = simd::load(hits.t);
         }
-        // the next node to process is adjacent to the current one:
-        // Either it's the left node from this node, or the right subtree from
-        // the parent of a leaf node.
-        // If the current node is a parent node, then the directly
-        // adjacent node is the root of the left subtree, since it's the first
-        // node that we build when recurring in buildBVHNode().
-        //
-        // If the current node is a leaf node, then `node_index + 1` is the end
-        // of the current subtree that we're visiting. Since nodes are stored in
-        // pre-order, the right subtree is pushed directly after the left
-        // subtree from a given parent. This means that `node_index + 1` in this
-        // case is the right node from the previous parent.
         node_index += 1;
     }
-
-    return {result, closestHit};
 }
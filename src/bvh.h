@@ -13,8 +13,13 @@
 
 #include <aabb.h>
 #include <geometry.h>
+#include <packet.h>
+#include <geometry_arrays.h>
+#include <stats.h>
 
+#include <algorithm>
 #include <span>
+#include <utility>
 #include <vector>
 
 namespace bvh {
@@ -34,6 +39,16 @@ struct bvh_node {
                       // objects that the leaf node represents.
     int objectCount;
 };
+// How the builder chooses where to split a set of objects.
+enum class split_method {
+    // Split at the middle of the longest axis. Cheap to build, but produces
+    // unbalanced trees for clustered objects.
+    midpoint,
+    // Binned surface area heuristic. Also decides the leaf sizes through its
+    // cost model.
+    sah,
+};
+
 struct tree_builder {
     std::vector<int> node_ends;
     std::vector<aabb> boxes;
@@ -41,25 +56,101 @@ struct tree_builder {
     std::vector<geometry> geoms;
 
     constexpr size_t start() const { return geoms.size(); }
-    void finish(size_t start) noexcept;
+    // Builds a new root over geoms[start:]. Big ranges are built with OpenMP
+    // tasks when available.
+    void finish(size_t start,
+                split_method method = split_method::sah) noexcept;
+};
+// Read only view of a built tree. Either a tree_builder or the tree stored
+// in a scene file (see scene_file.h).
+struct tree_view {
+    std::span<int const> node_ends;
+    std::span<aabb const> boxes;
+    std::span<bvh_node const> nodes;
+    std::span<geometry const> geoms;
+
+    constexpr tree_view() = default;
+    constexpr tree_view(tree_builder const &bld)
+        : node_ends(bld.node_ends),
+          boxes(bld.boxes),
+          nodes(bld.nodes),
+          geoms(bld.geoms) {}
 };
+
+// Walk of the pre-order layout shared by the queries over it (tree and
+// tlas): subtrees whose box the ray misses in [minRayDist, maxT] are
+// skipped, and leaf(node) is called on every leaf reached. `maxT` is read
+// on every node, so a leaf that finds a closer hit clips the rest of the
+// walk by updating it. leaf() returns true to stop the walk.
+template <typename Leaf>
+inline void walk(std::span<aabb const> boxes, int const *node_ends,
+                 bvh_node const *nodes, ray const &r, real const &maxT,
+                 Leaf &&leaf) {
+    auto const tree_end = int(boxes.size());
+    int node_index = 0;
+    while (node_index < tree_end) {
+        RTWK_COUNT(nodesVisited, 1);
+        auto t = boxes[node_index].traverse(r);
+        t.max = std::min(t.max, maxT);
+        t.min = std::max(t.min, minRayDist);
+        if (t.isEmpty()) {
+            if (node_ends[node_index] <= node_index) std::unreachable();
+            node_index = node_ends[node_index];
+            continue;
+        }
+        if (nodes[node_index].objectIndex != -1 && leaf(node_index)) return;
+        // the next node to process is adjacent to the current one:
+        // Either it's the left node from this node, or the right subtree from
+        // the parent of a leaf node.
+        // If the current node is a parent node, then the directly
+        // adjacent node is the root of the left subtree, since it's the first
+        // node that we build when recurring in buildBVHNode().
+        //
+        // If the current node is a leaf node, then `node_index + 1` is the end
+        // of the current subtree that we're visiting. Since nodes are stored in
+        // pre-order, the right subtree is pushed directly after the left
+        // subtree from a given parent. This means that `node_index + 1` in this
+        // case is the right node from the previous parent.
+        node_index += 1;
+    }
+}
+
+// Closest hit of each lane of a ray_packet. `t` must be initialized with the
+// maximum distance of each lane.
+struct packet_hits {
+    geometry_ptr geoms[ray_packet::width];
+    alignas(32) real t[ray_packet::width];
+};
+
 struct tree {
     std::span<aabb const> boxes;
     bvh_node const *nodes;
     int const *node_ends;
     geometry const *geoms;
+    // Leaves are intersected from here, see geometry_arrays::build(bld).
+    geometry_arrays const *arrays;
 
-    constexpr tree(tree_builder const &bld)
+    constexpr tree(tree_view const &bld, geometry_arrays const &arrays)
         : boxes(bld.boxes),
           nodes(bld.nodes.data()),
           node_ends(bld.node_ends.data()),
-          geoms(bld.geoms.data()) {}
+          geoms(bld.geoms.data()),
+          arrays(&arrays) {}
 
     // @perf Using __attribute__((const)) here makes the image black,
     // which means that the arguments here are taken into consideration as only
     // pointers instead of requiring the data behind them.
-    std::pair<geometry_ptr, double> hitBVH(timed_ray const &,
-                                           double) const noexcept
+    std::pair<geometry_ptr, real> hitBVH(timed_ray const &,
+                                         real) const noexcept
         __attribute__((pure));
+    // Whether anything is hit in [minRayDist, maxT). Returns at the first
+    // leaf with a hit, so nodes are only clipped by maxT, never by a closer
+    // hit.
+    bool occluded(timed_ray const &, real maxT) const noexcept
+        __attribute__((pure));
+
+    // Intersects all the active lanes of the packet at once. Each node is
+    // fetched once for the whole packet and tested against every lane.
+    void hitPacket(ray_packet const &, packet_hits &) const noexcept;
 };
 };  // namespace bvh
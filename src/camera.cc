@@ -0,0 +1,80 @@
+#include "camera.h"
+
+#include "rtweekend.h"
+#include "sampler.h"
+#include "stats.h"
+
+static vec3 sample_square(sampler const &smp) {
+    // Returns the vector to a random point in the [-.5,-.5]-[+.5,+.5] unit
+    // square.
+    auto u = smp.get2D();
+    return vec3(u.x - 0.5, u.y - 0.5, 0);
+}
+static point3 defocus_disk_sample(camera const &cam, sampler const &smp) {
+    // Returns a random point in the camera defocus disk.
+    auto p = concentric_disk(smp.get2D());
+    return (p[0] * cam.defocus_disk_u) + (p[1] * cam.defocus_disk_v);
+}
+
+timed_ray get_ray(settings const &s, camera const &cam, int i, int j) {
+    // Construct a camera ray originating from the defocus disk and directed
+    // at a randomly sampled point around the pixel location i, j.
+    RTWK_COUNT(primaryRays, 1);
+
+    auto const smp = make_sampler(s);
+    auto offset = sample_square(smp);
+    auto pixel_sample = cam.pixel00_loc +
+                        ((i + offset.x()) * cam.pixel_delta_u) +
+                        ((j + offset.y()) * cam.pixel_delta_v);
+
+    auto ray_origin =
+        (s.defocus_angle <= 0) ? vec3{0, 0, 0} : defocus_disk_sample(cam, smp);
+    auto ray_direction = pixel_sample - ray_origin;
+    auto ray_time = smp.get1D();
+
+    return {ray(ray_origin, ray_direction), ray_time};
+}
+
+camera make_camera(settings const &s) {
+    camera cam;
+    cam.image_height = int(s.image_width / s.aspect_ratio);
+    cam.image_height = (cam.image_height < 1) ? 1 : cam.image_height;
+
+    // Determine viewport dimensions.
+    auto theta = degrees_to_radians(s.vfov);
+    auto h = tan(theta / 2);
+    auto viewport_height = 2 * h * s.focus_dist;
+    auto viewport_width =
+        viewport_height * (real(s.image_width) / cam.image_height);
+
+    // Calculate the u,v,w unit basis vectors for the camera coordinate
+    // frame.
+    cam.w = unit_vector(-s.lookat);
+    cam.u = unit_vector(cross(s.vup, cam.w));
+    cam.v = cross(cam.w, cam.u);
+
+    // Calculate the vectors across the horizontal and down the vertical
+    // viewport edges.
+    vec3 viewport_u =
+        viewport_width * cam.u;  // Vector across viewport horizontal edge
+    vec3 viewport_v =
+        viewport_height * -cam.v;  // Vector down viewport vertical edge
+
+    // Calculate the horizontal and vertical delta vectors from pixel to
+    // pixel.
+    cam.pixel_delta_u = viewport_u / s.image_width;
+    cam.pixel_delta_v = viewport_v / cam.image_height;
+
+    // Calculate the location of the upper left pixel.
+    auto viewport_upper_left =
+        -(s.focus_dist * cam.w) - viewport_u / 2 - viewport_v / 2;
+    cam.pixel00_loc =
+        viewport_upper_left + 0.5 * (cam.pixel_delta_u + cam.pixel_delta_v);
+
+    // Calculate the camera defocus disk basis vectors.
+    auto defocus_radius =
+        s.focus_dist * tan(degrees_to_radians(s.defocus_angle / 2));
+    cam.defocus_disk_u = cam.u * defocus_radius;
+    cam.defocus_disk_v = cam.v * defocus_radius;
+    return cam;
+}
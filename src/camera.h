@@ -0,0 +1,21 @@
+#pragma once
+
+#include "ray.h"
+#include "settings.h"
+#include "vec3.h"
+
+// Origin is at world origin.
+struct camera {
+    int image_height;     // Rendered image height
+    point3 pixel00_loc;   // Location of pixel 0, 0
+    vec3 pixel_delta_u;   // Offset to pixel to the right
+    vec3 pixel_delta_v;   // Offset to pixel below
+    vec3 u, v, w;         // Camera frame basis vectors
+    vec3 defocus_disk_u;  // Defocus disk horizontal radius
+    vec3 defocus_disk_v;  // Defocus disk vertical radius
+};
+
+camera make_camera(settings const &s);
+
+// Camera ray through a random spot around pixel i, j.
+timed_ray get_ray(settings const &s, camera const &cam, int i, int j);
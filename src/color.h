@@ -15,7 +15,7 @@
 
 using color = vec3;
 
-inline double linear_to_gamma(double linear_component) {
+inline real linear_to_gamma(real linear_component) {
     if (linear_component > 0) return sqrt(linear_component);
 
     return 0;
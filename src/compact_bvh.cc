@@ -0,0 +1,242 @@
+#include "compact_bvh.h"
+
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <tracy/Tracy.hpp>
+
+#include "hittable.h"
+#include "stats.h"
+#include "trace_colors.h"
+
+namespace bvh {
+
+// 2^e, built straight from the exponent bits.
+static double exp2i(int e) {
+    return std::bit_cast<double>(uint64_t(e + 1023) << 52);
+}
+
+static uint8_t quantizeDown(double x, double origin, double scale) {
+    auto q = std::clamp(std::floor((x - origin) / scale), 0., 255.);
+    // the subtraction may round up; make sure we stay below `x`.
+    while (q > 0 && origin + q * scale > x) --q;
+    return uint8_t(q);
+}
+
+static uint8_t quantizeUp(double x, double origin, double scale) {
+    auto q = std::clamp(std::ceil((x - origin) / scale), 0., 255.);
+    while (q < 255 && origin + q * scale < x) ++q;
+    return uint8_t(q);
+}
+
+static compact_node quantizeNode(wide_node const &wn) {
+    compact_node cn{};
+    cn.childCount = uint8_t(wn.childCount);
+
+    real const *mins[3] = {wn.minx, wn.miny, wn.minz};
+    real const *maxs[3] = {wn.maxx, wn.maxy, wn.maxz};
+
+    for (int axis = 0; axis < 3; ++axis) {
+        auto lo = infinity;
+        auto hi = -infinity;
+        for (int i = 0; i < wn.childCount; ++i) {
+            lo = std::min(lo, mins[axis][i]);
+            hi = std::max(hi, maxs[axis][i]);
+        }
+
+        // round the origin down so that it's still below every child.
+        auto origin = float(lo);
+        if (origin > lo) origin = std::nextafter(origin, std::numeric_limits<float>::lowest());
+
+        // a flat node (hi == origin) would take the log of 0.
+        int e = hi > origin ? int(std::ceil(std::log2((hi - origin) / 255)))
+                            : -126;
+        e = std::clamp(e, -126, 126);
+        // log2 may be off by one ulp at the boundary.
+        while (e < 126 && origin + 255 * exp2i(e) < hi) ++e;
+
+        cn.origin[axis] = origin;
+        cn.exponent[axis] = int8_t(e);
+
+        auto scale = exp2i(e);
+        for (int i = 0; i < wn.childCount; ++i) {
+            cn.qlo[axis][i] = quantizeDown(mins[axis][i], origin, scale);
+            cn.qhi[axis][i] = quantizeUp(maxs[axis][i], origin, scale);
+        }
+    }
+
+    for (int i = 0; i < wn.childCount; ++i) {
+        assert(wn.count[i] <= compact_tree::maxLeafObjects);
+        cn.first[i] = wn.first[i];
+        cn.count[i] = uint16_t(wn.count[i]);
+    }
+    return cn;
+}
+
+bool compact_tree::fits(wide_tree const &wide) {
+    for (auto const &wn : wide.nodes) {
+        for (int i = 0; i < wn.childCount; ++i) {
+            if (wn.count[i] > maxLeafObjects) return false;
+        }
+    }
+    return true;
+}
+
+compact_tree compact_tree::quantize(wide_tree const &wide) {
+    ZoneScopedN("compact bvh quantize");
+    compact_tree out;
+    out.root = wide.root;
+    out.nodes.reserve(wide.nodes.size());
+    for (auto const &wn : wide.nodes) out.nodes.emplace_back(quantizeNode(wn));
+    return out;
+}
+
+std::pair<geometry_ptr, real> compact_tree::hitBVH(
+    geometry_arrays const &arrays, timed_ray const &r,
+    real closestHit) const noexcept {
+    ZoneNamedN(zone, "compact bvh hit", filters::treeHit);
+    geometry_ptr result = nullptr;
+
+    auto const ox = simd::broadcast(r.r.orig.x());
+    auto const oy = simd::broadcast(r.r.orig.y());
+    auto const oz = simd::broadcast(r.r.orig.z());
+    auto const idx = simd::broadcast(1 / r.r.dir.x());
+    auto const idy = simd::broadcast(1 / r.r.dir.y());
+    auto const idz = simd::broadcast(1 / r.r.dir.z());
+    auto const tmin = simd::broadcast(minRayDist);
+
+    struct entry {
+        real tnear;
+        int first;
+        int count;
+    };
+    entry stack[wide_tree::stackSize];
+    int top = 0;
+    if (!empty()) stack[top++] = {minRayDist, root, 0};
+
+    while (top > 0) {
+        auto const e = stack[--top];
+        if (e.tnear > closestHit) continue;
+
+        if (e.count != 0) {
+            std::tie(result, closestHit) =
+                arrays.hit(e.first, r, result, closestHit);
+            continue;
+        }
+
+        auto const &n = nodes[e.first];
+        RTWK_COUNT(nodesVisited, 1);
+
+        // Dequantize and intersect one axis. The box is moved into the ray's
+        // frame first so that the origin subtraction is shared by both
+        // planes.
+        auto slab = [&n](int axis, simd::v4 o, simd::v4 id, simd::v4 &t0,
+                         simd::v4 &t1) {
+            auto base = simd::broadcast(n.origin[axis]) - o;
+            auto scale = simd::broadcast(exp2i(n.exponent[axis]));
+            t0 = (base + simd::from_u8(n.qlo[axis]) * scale) * id;
+            t1 = (base + simd::from_u8(n.qhi[axis]) * scale) * id;
+        };
+
+        simd::v4 tx0, tx1, ty0, ty1, tz0, tz1;
+        slab(0, ox, idx, tx0, tx1);
+        slab(1, oy, idy, ty0, ty1);
+        slab(2, oz, idz, tz0, tz1);
+
+        auto tnear =
+            simd::max(simd::max(simd::min(tx0, tx1), simd::min(ty0, ty1)),
+                      simd::max(simd::min(tz0, tz1), tmin));
+        auto tfar = simd::min(
+            simd::min(simd::max(tx0, tx1), simd::max(ty0, ty1)),
+            simd::min(simd::max(tz0, tz1), simd::broadcast(closestHit)));
+
+        auto hits = simd::bits(simd::less_eq(tnear, tfar)) &
+                    ((1 << n.childCount) - 1);
+        if (!hits) continue;
+
+        alignas(32) real tnears[compact_node::width];
+        simd::store(tnears, tnear);
+
+        // There's no room for the octant order table in the node, so sort
+        // the hit children by distance instead (furthest pushed first).
+        int pending[compact_node::width];
+        int count = 0;
+        for (; hits; hits &= hits - 1) {
+            int slot = std::countr_zero(unsigned(hits));
+            int i = count++;
+            while (i > 0 && tnears[pending[i - 1]] < tnears[slot]) {
+                pending[i] = pending[i - 1];
+                --i;
+            }
+            pending[i] = slot;
+        }
+        for (int i = 0; i < count; ++i) {
+            auto slot = pending[i];
+            assert(top < wide_tree::stackSize);
+            stack[top++] = {tnears[slot], n.first[slot], n.count[slot]};
+        }
+    }
+
+    return {result, closestHit};
+}
+
+bool compact_tree::occluded(geometry_arrays const &arrays, timed_ray const &r,
+                            real const maxT) const noexcept {
+    ZoneNamedN(zone, "compact bvh occluded", filters::treeHit);
+
+    // NOTE: @cutnpaste from hitBVH, without the sort.
+    auto const ox = simd::broadcast(r.r.orig.x());
+    auto const oy = simd::broadcast(r.r.orig.y());
+    auto const oz = simd::broadcast(r.r.orig.z());
+    auto const idx = simd::broadcast(1 / r.r.dir.x());
+    auto const idy = simd::broadcast(1 / r.r.dir.y());
+    auto const idz = simd::broadcast(1 / r.r.dir.z());
+    auto const tmin = simd::broadcast(minRayDist);
+    auto const tmax = simd::broadcast(maxT);
+
+    // Only inner nodes are pushed.
+    int stack[wide_tree::stackSize];
+    int top = 0;
+    if (!empty()) stack[top++] = root;
+
+    while (top > 0) {
+        auto const &n = nodes[stack[--top]];
+        RTWK_COUNT(nodesVisited, 1);
+
+        auto slab = [&n](int axis, simd::v4 o, simd::v4 id, simd::v4 &t0,
+                         simd::v4 &t1) {
+            auto base = simd::broadcast(n.origin[axis]) - o;
+            auto scale = simd::broadcast(exp2i(n.exponent[axis]));
+            t0 = (base + simd::from_u8(n.qlo[axis]) * scale) * id;
+            t1 = (base + simd::from_u8(n.qhi[axis]) * scale) * id;
+        };
+
+        simd::v4 tx0, tx1, ty0, ty1, tz0, tz1;
+        slab(0, ox, idx, tx0, tx1);
+        slab(1, oy, idy, ty0, ty1);
+        slab(2, oz, idz, tz0, tz1);
+
+        auto tnear =
+            simd::max(simd::max(simd::min(tx0, tx1), simd::min(ty0, ty1)),
+                      simd::max(simd::min(tz0, tz1), tmin));
+        auto tfar =
+            simd::min(simd::min(simd::max(tx0, tx1), simd::max(ty0, ty1)),
+                      simd::min(simd::max(tz0, tz1), tmax));
+
+        auto hits = simd::bits(simd::less_eq(tnear, tfar)) &
+                    ((1 << n.childCount) - 1);
+        for (; hits; hits &= hits - 1) {
+            int slot = std::countr_zero(unsigned(hits));
+            if (n.count[slot] == 0) {
+                assert(top < wide_tree::stackSize);
+                stack[top++] = n.first[slot];
+            } else if (arrays.occluded(n.first[slot], r, maxT)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+}  // namespace bvh
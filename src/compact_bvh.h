@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "geometry.h"
+#include "wide_bvh.h"
+
+namespace bvh {
+
+// Quantized version of wide_node that fits in a single cache line (vs. the
+// ~3.5 lines of wide_node).
+// Child bounds are stored as 8 bit offsets from `origin`, in steps of
+// 2^exponent, and rounded outwards so that the boxes are never smaller than
+// the real ones.
+struct alignas(64) compact_node {
+    static constexpr int width = wide_node::width;
+
+    float origin[3];
+    int8_t exponent[3];
+    uint8_t childCount;
+
+    // lanes are [axis][child]
+    uint8_t qlo[3][width];
+    uint8_t qhi[3][width];
+
+    // Same meaning as in wide_node: count == 0 means `first` is a node index,
+    // otherwise it's a leaf of geometry_arrays.
+    int32_t first[width];
+    uint16_t count[width];
+};
+static_assert(sizeof(compact_node) == 64);
+
+struct compact_tree {
+    // Leaves with more objects don't fit compact_node::count.
+    static constexpr int maxLeafObjects = UINT16_MAX;
+
+    std::vector<compact_node> nodes;
+    int root = -1;
+
+    constexpr bool empty() const { return root < 0; }
+
+    // Quantizes every node of the wide tree. Node indices are kept as is, so
+    // the stack depth bound of wide_tree holds here too. The tree must
+    // fit().
+    static compact_tree quantize(wide_tree const &wide);
+    // Whether every leaf of the wide tree has at most maxLeafObjects.
+    static bool fits(wide_tree const &wide);
+
+    // `arrays` are the ones the wide tree was collapsed with.
+    std::pair<geometry_ptr, real> hitBVH(geometry_arrays const &arrays,
+                                         timed_ray const &,
+                                         real) const noexcept
+        __attribute__((pure));
+    // Whether anything is hit in [minRayDist, maxT). Children are visited
+    // in any order and leaves are tested as soon as their parent is, since
+    // the first hit found ends the query.
+    bool occluded(geometry_arrays const &arrays, timed_ray const &,
+                  real maxT) const noexcept __attribute__((pure));
+};
+
+}  // namespace bvh
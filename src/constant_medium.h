@@ -19,7 +19,7 @@
 
 struct constant_medium {
     traversable_geometry geom;
-    double neg_inv_density;
-    constant_medium(traversable_geometry boundary, double density)
+    real neg_inv_density;
+    constant_medium(traversable_geometry boundary, real density)
         : geom(boundary), neg_inv_density(-1 / density) {}
 };
@@ -3,11 +3,11 @@
 #include <format>
 
 template <>
-struct std::formatter<vec3> : public std::formatter<double> {
-    // NOTE: parsing is done by <double>
+struct std::formatter<vec3> : public std::formatter<real> {
+    // NOTE: parsing is done by <real>
 
     auto format(vec3 const &v, auto &ctx) const {
-        using df = std::formatter<double>;
+        using df = std::formatter<real>;
 
         *ctx.out()++ = '[';
         auto out = df::format(v[0], ctx);
@@ -14,6 +14,7 @@
 #include "sphere.h"
 #include "trace_colors.h"
 #include "transforms.h"
+#include "triangle.h"
 #include "vec3.h"
 
 //  @maybe separating them in tags is interesting
@@ -27,7 +28,7 @@
 // we can drop the `closestHit` checks inside each hit and only check when we're
 // aggregating.
 
-enum class geometry_kind : int { box, sphere, quad };
+enum class geometry_kind : int { box, sphere, quad, triangle };
 struct geometry {
     int relIndex;
     geometry_kind kind;
@@ -36,11 +37,14 @@ struct geometry {
         sphere sphere;
         quad quad;
         aabb box;
+        triangle triangle;
     } data;
 
     geometry(sphere sph) : kind(geometry_kind::sphere), data{.sphere = sph} {}
     geometry(quad q) : kind(geometry_kind::quad), data{.quad = q} {}
     geometry(aabb b) : kind(geometry_kind::box), data{.box = b} {}
+    geometry(triangle t)
+        : kind(geometry_kind::triangle), data{.triangle = t} {}
 
     void applyTransform(transform tf) {
         switch (kind) {
@@ -53,6 +57,9 @@ struct geometry {
             case geometry_kind::box:
                 data.box = tf.applyForward(data.box);
                 break;
+            case geometry_kind::triangle:
+                data.triangle = triangle::applyTransform(data.triangle, tf);
+                break;
         }
     }
 
@@ -64,6 +71,8 @@ struct geometry {
                 return data.quad.bounding_box();
             case geometry_kind::sphere:
                 return data.sphere.bounding_box();
+            case geometry_kind::triangle:
+                return data.triangle.bounding_box();
         }
         std::unreachable();
     }
@@ -78,13 +87,18 @@ struct geometry_ptr {
         sphere const *sphere;
         aabb const *box;
         quad const *quad;
+        triangle const *triangle;
 
         constexpr _ptrs(struct sphere const *sph) : sphere(sph) {}
         constexpr _ptrs(aabb const *box) : box(box) {}
         constexpr _ptrs(struct quad const *q) : quad(q) {}
+        constexpr _ptrs(struct triangle const *t) : triangle(t) {}
         constexpr _ptrs() = default;
 
     } ptr;
+    // Set when the geometry was hit through an instance (see instance.h), in
+    // which case the geometry itself is in object space.
+    transform const *instance = nullptr;
 
     constexpr geometry_ptr() = default;
 
@@ -93,6 +107,8 @@ struct geometry_ptr {
     constexpr geometry_ptr(aabb const *box)
         : kind(geometry_kind::box), ptr(box) {}
     constexpr geometry_ptr(quad const *q) : kind(geometry_kind::quad), ptr(q) {}
+    constexpr geometry_ptr(triangle const *t)
+        : kind(geometry_kind::triangle), ptr(t) {}
 
     constexpr operator bool() const {
         return std::bit_cast<uint64_t>(ptr) != 0;
@@ -109,12 +125,20 @@ struct geometry_ptr {
                 new (&ptr) _ptrs(&gp->data.sphere);
             case geometry_kind::quad:
                 new (&ptr) _ptrs(&gp->data.quad);
+            case geometry_kind::triangle:
+                new (&ptr) _ptrs(&gp->data.triangle);
         }
     }
 
     constexpr geometry_ptr(geometry const &gpref) : geometry_ptr(&gpref) {}
 
-    vec3 getNormal(point3 const &__restrict intersection, double time) const {
+    vec3 getNormal(point3 const &__restrict intersection, real time) const {
+        if (instance) {
+            auto local = *this;
+            local.instance = nullptr;
+            return instance->rotateForward(
+                local.getNormal(instance->applyInverse(intersection), time));
+        }
         switch (kind) {
             case geometry_kind::box:
                 return ptr.box->getNormal(intersection);
@@ -122,11 +146,19 @@ struct geometry_ptr {
                 return ptr.quad->getNormal();
             case geometry_kind::sphere:
                 return ptr.sphere->getNormal(intersection, time);
+            case geometry_kind::triangle:
+                return ptr.triangle->getNormal(intersection);
         }
     }
 
     uvs getUVs(point3 const &__restrict intersection,
                point3 const &__restrict normal) const {
+        if (instance) {
+            auto local = *this;
+            local.instance = nullptr;
+            return local.getUVs(instance->applyInverse(intersection),
+                                instance->rotateInverse(normal));
+        }
         switch (kind) {
             case geometry_kind::box:
                 return ptr.box->getUVs(intersection);
@@ -134,11 +166,13 @@ struct geometry_ptr {
                 return ptr.sphere->getUVs(normal);
             case geometry_kind::quad:
                 return ptr.quad->getUVs(intersection);
+            case geometry_kind::triangle:
+                return ptr.triangle->getUVs(intersection);
         }
     }
     // Returns something less than `minRayDist` when the ray does not hit.
     // TODO: write the result inconditionally everywhere.
-    double hit(timed_ray const &r) const {
+    real hit(timed_ray const &r) const {
         // geometry is already transformed, so we can skip and set the actual
         // point.
         switch (kind) {
@@ -148,6 +182,8 @@ struct geometry_ptr {
                 return ptr.sphere->hit(r);
             case geometry_kind::quad:
                 return ptr.quad->hit(r.r);
+            case geometry_kind::triangle:
+                return ptr.triangle->hit(r.r);
         }
     }
 };
@@ -182,6 +218,7 @@ struct traversable_geometry {
             case geometry_kind::sphere:
                 return g.data.sphere;
             case geometry_kind::quad:
+            case geometry_kind::triangle:
                 std::unreachable();
         }
     }
@@ -195,10 +232,10 @@ concept geometry_iterator = std::input_iterator<It> && requires(It const &it) {
 };
 
 template <geometry_iterator It>
-inline std::pair<geometry_ptr, double> hitSpan(It start, It end,
-                                               timed_ray const &r,
-                                               geometry_ptr best,
-                                               double closestHit) {
+inline std::pair<geometry_ptr, real> hitSpan(It start, It end,
+                                             timed_ray const &r,
+                                             geometry_ptr best,
+                                             real closestHit) {
     ZoneScopedNC("hit span", Ctp::Green);
     ZoneValue(objects.size());
 
@@ -220,8 +257,8 @@ inline std::pair<geometry_ptr, double> hitSpan(It start, It end,
 
 // @perf get rid of this as I start providing better iteration options to the
 // loop.
-inline std::pair<geometry_ptr, double> hitSpan(
+inline std::pair<geometry_ptr, real> hitSpan(
     std::span<geometry const> objects, timed_ray const &r, geometry_ptr best,
-    double closestHit) {
+    real closestHit) {
     return hitSpan(std::begin(objects), std::end(objects), r, best, closestHit);
 }
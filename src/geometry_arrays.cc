@@ -0,0 +1,225 @@
+#include "geometry_arrays.h"
+
+#include <algorithm>
+#include <bit>
+#include <tracy/Tracy.hpp>
+#include <type_traits>
+
+#include "bvh.h"
+#include "hittable.h"
+#include "interval.h"
+#include "stats.h"
+#include "trace_colors.h"
+
+int geometry_arrays::addLeaf(std::span<geometry const> objects) {
+    kind_ranges leaf{
+        .spheres = {uint32_t(spheres.size()), uint32_t(spheres.size())},
+        .quads = {uint32_t(quads.size()), uint32_t(quads.size())},
+        .boxes = {uint32_t(boxes.size()), uint32_t(boxes.size())},
+        .triangles = {uint32_t(triangles.size()), uint32_t(triangles.size())},
+    };
+    for (auto const &g : objects) {
+        switch (g.kind) {
+            case geometry_kind::sphere:
+                spheres.push_back(g.data.sphere);
+                sphereRel.push_back(g.relIndex);
+                ++leaf.spheres.end;
+                break;
+            case geometry_kind::quad:
+                quads.push_back(g.data.quad);
+                quadRel.push_back(g.relIndex);
+                ++leaf.quads.end;
+                break;
+            case geometry_kind::box:
+                boxes.push_back(g.data.box);
+                boxRel.push_back(g.relIndex);
+                ++leaf.boxes.end;
+                break;
+            case geometry_kind::triangle:
+                triangles.push_back(g.data.triangle);
+                triangleRel.push_back(g.relIndex);
+                ++leaf.triangles.end;
+                break;
+        }
+    }
+    leaves.push_back(leaf);
+    return int(leaves.size()) - 1;
+}
+
+static void buildBlocks(geometry_arrays &arrays) {
+    arrays.sphereBlocks = sphere_block::build(arrays.spheres);
+    arrays.triangleBlocks = triangle_block::build(arrays.triangles);
+}
+
+geometry_arrays geometry_arrays::build(bvh::tree_view const &bld,
+                                       bool const blocks) {
+    ZoneScopedN("geometry arrays build");
+    geometry_arrays out;
+    out.nodeLeaves.resize(bld.nodes.size(), -1);
+    for (size_t node = 0; node < bld.nodes.size(); ++node) {
+        auto const &n = bld.nodes[node];
+        if (n.objectIndex == -1) continue;
+        out.nodeLeaves[node] = out.addLeaf(
+            bld.geoms.subspan(n.objectIndex, n.objectCount));
+    }
+    if (blocks) buildBlocks(out);
+    return out;
+}
+
+geometry_arrays geometry_arrays::build(std::span<geometry const> objects,
+                                       bool const blocks) {
+    geometry_arrays out;
+    out.addLeaf(objects);
+    if (blocks) buildBlocks(out);
+    return out;
+}
+
+// Closest hit among objects[r.start, r.end), each one of the same kind.
+template <typename T>
+static void hitKind(std::vector<T> const &objects, std::vector<int> const &rel,
+                    range const rg, timed_ray const &r, geometry_ptr &best,
+                    real &closestHit) {
+    for (auto i = rg.start; i < rg.end; ++i) {
+        real res;
+        if constexpr (std::is_same_v<T, sphere>) {
+            res = objects[i].hit(r);
+        } else {
+            res = objects[i].hit(r.r);
+        }
+        if (interval{minRayDist, closestHit}.contains(res)) {
+            best = &objects[i];
+            best.relIndex = rel[i];
+            closestHit = res;
+        }
+    }
+}
+
+// Same as hitKind, `width` objects at a time from their SoA blocks.
+template <typename Block, typename T>
+static void hitBlocks(std::vector<Block> const &blocks,
+                      std::vector<T> const &objects,
+                      std::vector<int> const &rel, range const rg,
+                      timed_ray const &r, geometry_ptr &best,
+                      real &closestHit) {
+    static constexpr int width = Block::width;
+    auto const first = int(rg.start);
+    auto const end = int(rg.end);
+    if (first == end) return;
+    for (int blockIndex = first / width; blockIndex * width < end;
+         ++blockIndex) {
+        auto const base = blockIndex * width;
+        // lanes of the block that are part of the leaf.
+        auto lo = std::max(first - base, 0);
+        auto hi = std::min(end - base, width);
+        int inLeaf = ((1 << hi) - 1) & ~((1 << lo) - 1);
+
+        auto maxT = simd::broadcast(closestHit);
+        auto t = blocks[blockIndex].hit(r, maxT);
+        auto hits = simd::bits(simd::less(t, maxT)) & inLeaf;
+        if (!hits) continue;
+
+        alignas(32) real ts[width];
+        simd::store(ts, t);
+        for (; hits; hits &= hits - 1) {
+            auto i = base + std::countr_zero(unsigned(hits));
+            if (ts[i - base] < closestHit) {
+                best = &objects[i];
+                best.relIndex = rel[i];
+                closestHit = ts[i - base];
+            }
+        }
+    }
+}
+
+std::pair<geometry_ptr, real> geometry_arrays::hit(int const leaf,
+                                                   timed_ray const &r,
+                                                   geometry_ptr best,
+                                                   real closestHit) const {
+    ZoneScopedNC("hit leaf", Ctp::Green);
+    auto const &ranges = leaves[leaf];
+    RTWK_COUNT(primitiveTests,
+               ranges.spheres.end - ranges.spheres.start +
+                   ranges.triangles.end - ranges.triangles.start +
+                   ranges.quads.end - ranges.quads.start +
+                   ranges.boxes.end - ranges.boxes.start);
+
+    // Each kind has blocks when they're enabled and it has objects at all,
+    // so e.g. a scene of meshes has triangle blocks but no sphere blocks.
+    if (sphereBlocks.empty()) {
+        hitKind(spheres, sphereRel, ranges.spheres, r, best, closestHit);
+    } else {
+        hitBlocks(sphereBlocks, spheres, sphereRel, ranges.spheres, r, best,
+                  closestHit);
+    }
+    if (triangleBlocks.empty()) {
+        hitKind(triangles, triangleRel, ranges.triangles, r, best, closestHit);
+    } else {
+        hitBlocks(triangleBlocks, triangles, triangleRel, ranges.triangles, r,
+                  best, closestHit);
+    }
+    hitKind(quads, quadRel, ranges.quads, r, best, closestHit);
+    hitKind(boxes, boxRel, ranges.boxes, r, best, closestHit);
+
+    return {best, closestHit};
+}
+
+// Whether any of objects[r.start, r.end) is hit in [minRayDist, maxT).
+template <typename T>
+static bool anyKind(std::vector<T> const &objects, range const rg,
+                    timed_ray const &r, real maxT) {
+    for (auto i = rg.start; i < rg.end; ++i) {
+        real res;
+        if constexpr (std::is_same_v<T, sphere>) {
+            res = objects[i].hit(r);
+        } else {
+            res = objects[i].hit(r.r);
+        }
+        if (interval{minRayDist, maxT}.contains(res)) return true;
+    }
+    return false;
+}
+
+// Same as anyKind, `width` objects at a time from their SoA blocks.
+template <typename Block>
+static bool anyBlocks(std::vector<Block> const &blocks, range const rg,
+                      timed_ray const &r, real maxT) {
+    static constexpr int width = Block::width;
+    auto const first = int(rg.start);
+    auto const end = int(rg.end);
+    auto const maxTs = simd::broadcast(maxT);
+    for (int blockIndex = first / width; blockIndex * width < end;
+         ++blockIndex) {
+        auto const base = blockIndex * width;
+        auto lo = std::max(first - base, 0);
+        auto hi = std::min(end - base, width);
+        int inLeaf = ((1 << hi) - 1) & ~((1 << lo) - 1);
+
+        auto t = blocks[blockIndex].hit(r, maxTs);
+        if (simd::bits(simd::less(t, maxTs)) & inLeaf) return true;
+    }
+    return false;
+}
+
+bool geometry_arrays::occluded(int const leaf, timed_ray const &r,
+                               real const maxT) const {
+    ZoneScopedNC("occluded leaf", Ctp::Green);
+    auto const &ranges = leaves[leaf];
+    // Counts every object, even those skipped after the first hit.
+    RTWK_COUNT(primitiveTests,
+               ranges.spheres.end - ranges.spheres.start +
+                   ranges.triangles.end - ranges.triangles.start +
+                   ranges.quads.end - ranges.quads.start +
+                   ranges.boxes.end - ranges.boxes.start);
+
+    // Large quads and boxes (walls, floors) are the likeliest occluders, and
+    // the cheapest to test.
+    if (anyKind(quads, ranges.quads, r, maxT)) return true;
+    if (anyKind(boxes, ranges.boxes, r, maxT)) return true;
+    bool const sphereHit =
+        sphereBlocks.empty() ? anyKind(spheres, ranges.spheres, r, maxT)
+                             : anyBlocks(sphereBlocks, ranges.spheres, r, maxT);
+    if (sphereHit) return true;
+    return triangleBlocks.empty()
+               ? anyKind(triangles, ranges.triangles, r, maxT)
+               : anyBlocks(triangleBlocks, ranges.triangles, r, maxT);
+}
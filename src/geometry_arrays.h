@@ -0,0 +1,70 @@
+#pragma once
+
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "aabb.h"
+#include "geometry.h"
+#include "quad.h"
+#include "ray.h"
+#include "rtweekend.h"
+#include "sphere.h"
+#include "sphere_block.h"
+#include "triangle.h"
+
+namespace bvh {
+struct tree_view;
+}
+
+// Where the objects of a leaf are, in each of the geometry_arrays.
+struct kind_ranges {
+    range spheres;
+    range quads;
+    range boxes;
+    range triangles;
+};
+
+// The geometries of the leaves, split in one homogeneous array per kind. A
+// leaf is a kind_ranges, so intersecting it is one loop per kind, without
+// the switch of geometry_ptr::hit.
+//
+// `geometry` is still what the builder partitions and what transformAll
+// touches; these arrays are a copy made afterwards.
+struct geometry_arrays {
+    std::vector<sphere> spheres;
+    std::vector<quad> quads;
+    std::vector<aabb> boxes;
+    std::vector<triangle> triangles;
+    // relIndex of every object, parallel to the arrays above.
+    std::vector<int> sphereRel;
+    std::vector<int> quadRel;
+    std::vector<int> boxRel;
+    std::vector<int> triangleRel;
+
+    // SoA copies of `spheres` and `triangles`. Empty when disabled.
+    std::vector<sphere_block> sphereBlocks;
+    std::vector<triangle_block> triangleBlocks;
+
+    std::vector<kind_ranges> leaves;
+    // Leaf index of every node of the tree_builder these were built from, or
+    // -1 for inner nodes.
+    std::vector<int> nodeLeaves;
+
+    // Adds the objects as a new leaf and returns its index.
+    int addLeaf(std::span<geometry const> objects);
+
+    // Copies every leaf of the tree. Leaves are visited in pre-order, which
+    // is also the order of their objects in bld.geoms.
+    static geometry_arrays build(bvh::tree_view const &bld, bool blocks);
+    // A single leaf with all the objects.
+    static geometry_arrays build(std::span<geometry const> objects,
+                                 bool blocks);
+
+    std::pair<geometry_ptr, real> hit(int leaf, timed_ray const &r,
+                                      geometry_ptr best,
+                                      real closestHit) const;
+    // Whether any object of the leaf is hit in [minRayDist, maxT). Stops at
+    // the first one found.
+    bool occluded(int leaf, timed_ray const &r, real maxT) const;
+};
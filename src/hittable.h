@@ -25,8 +25,8 @@ struct lightInfo {
 struct geometry;
 struct geometryFound {
     geometry const *ptr;
-    double hit;
+    real hit;
 };
 
 // Minimum ray distance prepared to remove any zero rounding errors.
-static constexpr double minRayDist = 0.001;
+static constexpr real minRayDist = 0.001;
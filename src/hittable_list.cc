@@ -1,7 +1,9 @@
 #include "hittable_list.h"
 
 #include <algorithm>
+#include <bit>
 #include <print>
+#include <utility>
 #include <tracy/Tracy.hpp>
 
 #include "bvh.h"
@@ -11,25 +13,95 @@
 #include "interval.h"
 #include "ray.h"
 #include "rtweekend.h"
+#include "scene_file.h"
+#include "stats.h"
 #include "trace_colors.h"
 
-std::pair<geometry_ptr, double> hittable_list::hitSelect(
+std::pair<geometry_ptr, real> hittable_list::hitSelect(
     timed_ray const &r) const {
     ZoneNamedN(_tracy, "hittable_list hit", filters::surfaceHit);
+    RTWK_COUNT(rays, 1);
 
     geometry_ptr best;
-    double closestHit;
+    real closestHit;
 
-    std::tie(best, closestHit) = bvh::tree(treebld).hitBVH(r, infinity);
+    switch (layout) {
+        case tree_layout::binary:
+            std::tie(best, closestHit) =
+                bvh::tree(treeView(), treeArrays).hitBVH(r, infinity);
+            break;
+        case tree_layout::wide:
+            std::tie(best, closestHit) =
+                wideTree.hitBVH(treeArrays, r, infinity);
+            break;
+        case tree_layout::compact:
+            std::tie(best, closestHit) =
+                compactTree.hitBVH(treeArrays, r, infinity);
+            break;
+    }
 
     {
         ZoneNamedN(_tracy, "hit individuals", filters::hit);
-        std::tie(best, closestHit) = hitSpan(selectGeoms, r, best, closestHit);
+        std::tie(best, closestHit) = selectArrays.hit(0, r, best, closestHit);
+    }
+
+    if (!tlas.empty()) {
+        auto [inst, t] = tlas.hit(r, closestHit);
+        if (inst) std::tie(best, closestHit) = std::pair{inst, t};
     }
 
     return {best, closestHit};
 }
 
+void hittable_list::hitSelect(ray_packet const &p,
+                              bvh::packet_hits &hits) const {
+    ZoneNamedN(_tracy, "hittable_list packet hit", filters::surfaceHit);
+    RTWK_COUNT(rays, std::popcount(unsigned(p.active)));
+
+    for (int i = 0; i < ray_packet::width; ++i) {
+        hits.geoms[i] = nullptr;
+        hits.t[i] = infinity;
+    }
+
+    bvh::tree(treeView(), treeArrays).hitPacket(p, hits);
+
+    {
+        ZoneNamedN(_tracy, "hit individuals", filters::hit);
+        for (int i = 0; i < ray_packet::width; ++i) {
+            if (!((p.active >> i) & 1)) continue;
+            std::tie(hits.geoms[i], hits.t[i]) =
+                selectArrays.hit(0, p.lane(i), hits.geoms[i], hits.t[i]);
+
+            if (tlas.empty()) continue;
+            auto [inst, t] = tlas.hit(p.lane(i), hits.t[i]);
+            if (inst) std::tie(hits.geoms[i], hits.t[i]) = std::pair{inst, t};
+        }
+    }
+}
+
+bool hittable_list::occluded(timed_ray const &r, real maxT) const {
+    ZoneNamedN(_tracy, "hittable_list occluded", filters::surfaceHit);
+    RTWK_COUNT(shadowRays, 1);
+
+    // The unbounded objects first: they are few and big, so the likeliest to
+    // be in the way.
+    if (selectArrays.occluded(0, r, maxT)) return true;
+
+    bool hit = false;
+    switch (layout) {
+        case tree_layout::binary:
+            hit = bvh::tree(treeView(), treeArrays).occluded(r, maxT);
+            break;
+        case tree_layout::wide:
+            hit = wideTree.occluded(treeArrays, r, maxT);
+            break;
+        case tree_layout::compact:
+            hit = compactTree.occluded(treeArrays, r, maxT);
+            break;
+    }
+    return hit || (!tlas.empty() && tlas.occluded(r, maxT));
+}
+
 void hittable_list::transformAll(transform tf) {
     for (auto &obj : treebld.geoms) {
         obj.applyTransform(tf);
@@ -40,6 +112,13 @@ void hittable_list::transformAll(transform tf) {
     for (auto & obj : selectGeoms) {
         obj.applyTransform(tf);
     }
+    // the triangles themselves don't move, their vertices do.
+    for (auto &m : meshes) {
+        m->applyTransform(tf);
+    }
+    for (auto &inst : tlas.instances) {
+        inst.tf = transform::compose(tf, inst.tf);
+    }
     for (auto &obj : cms) {
         switch (obj.geom.kind) {
             case traversable_geometry::kind::box:
@@ -53,6 +132,76 @@ void hittable_list::transformAll(transform tf) {
     }
 }
 
+// Objects whose box covers more than this fraction of the scene's surface
+// area (e.g. a background sphere) would be hit by nearly every ray anyway,
+// so they stay out of the tree.
+static constexpr real unboundedArea = 0.5;
+
+static void moveBoundedToTree(bvh::tree_builder &treebld,
+                              std::vector<geometry> &selectGeoms) {
+    ZoneScopedN("move bounded geometries");
+    aabb scene = empty_aabb;
+    for (auto const &g : treebld.geoms) scene = aabb(scene, g.bounding_box());
+    for (auto const &g : selectGeoms) scene = aabb(scene, g.bounding_box());
+    auto const limit = unboundedArea * scene.surface_area();
+
+    auto start = treebld.start();
+    std::erase_if(selectGeoms, [&](geometry const &g) {
+        if (g.bounding_box().surface_area() > limit) return false;
+        treebld.geoms.push_back(g);
+        return true;
+    });
+    if (treebld.start() != start) treebld.finish(start);
+}
+
+void hittable_list::prepare(settings const &s) {
+    layout = s.layout;
+    // scene files are written after this already.
+    if (!file) moveBoundedToTree(treebld, selectGeoms);
+    // @perf with a scene file this is still a pass over all the geometries,
+    // the arrays aren't stored in it.
+    treeArrays = geometry_arrays::build(treeView(), s.leaf_blocks);
+    selectArrays = geometry_arrays::build(selectGeoms, s.leaf_blocks);
+
+    for (auto &object : blases) {
+        if (!object->built()) object->build(s.leaf_blocks);
+    }
+    tlas.build();
+
+    if (layout != tree_layout::binary) {
+        auto wide = bvh::wide_tree::collapse(treeView(), treeArrays);
+        if (!wide.traversable()) {
+            // the binary layout is traversed without a stack.
+            std::println(stderr,
+                         "WARNING: The tree is {} wide levels deep, over the "
+                         "{} of the wide layouts. Using the binary layout.",
+                         wide.depth, bvh::wide_tree::maxDepth);
+            layout = tree_layout::binary;
+        } else if (layout == tree_layout::wide) {
+            wideTree = std::move(wide);
+        } else if (!bvh::compact_tree::fits(wide)) {
+            std::println(stderr,
+                         "WARNING: A leaf has over {} objects, which the "
+                         "compact layout can't store. Using the wide layout.",
+                         bvh::compact_tree::maxLeafObjects);
+            layout = tree_layout::wide;
+            wideTree = std::move(wide);
+        } else {
+            // the wide tree is only needed to build the compact one.
+            compactTree = bvh::compact_tree::quantize(wide);
+        }
+    }
+
+    lights = {};
+    lights.add(treeView().geoms, objects);
+    lights.add(selectGeoms, objects);
+}
+
+bvh::tree_view hittable_list::treeView() const {
+    if (file) return file->tree;
+    return treebld;
+}
+
 void hittable_list::add(lightInfo object, geometry geom) {
     geom.relIndex = objects.size();  // Make sure we link the texture/mat data.
     selectGeoms.emplace_back(geom);
@@ -64,6 +213,51 @@ void hittable_list::addTree(lightInfo object, geometry geom) {
     objects.emplace_back(object);
 }
 
+void hittable_list::add(lightInfo object, std::shared_ptr<mesh> m) {
+    auto relIndex = int(objects.size());
+    objects.emplace_back(object);
+
+    auto start = treebld.start();
+    treebld.geoms.reserve(start + m->triangleCount());
+    for (uint32_t i = 0; i < m->triangleCount(); ++i) {
+        geometry g(triangle(m.get(), 3 * i));
+        g.relIndex = relIndex;
+        treebld.geoms.push_back(g);
+    }
+    if (treebld.start() != start) treebld.finish(start);
+    meshes.push_back(std::move(m));
+}
+
+bvh::blas &hittable_list::addBlas() {
+    return *blases.emplace_back(std::make_shared<bvh::blas>());
+}
+
+void hittable_list::addTo(bvh::blas &object, lightInfo info, geometry geom) {
+    geom.relIndex = objects.size();  // Make sure we link the texture/mat data.
+    object.treebld.geoms.emplace_back(geom);
+    objects.emplace_back(info);
+}
+
+void hittable_list::addTo(bvh::blas &object, lightInfo info,
+                          std::shared_ptr<mesh> m) {
+    auto relIndex = int(objects.size());
+    objects.emplace_back(info);
+
+    // blas::build finishes every geometry as a single root.
+    auto &geoms = object.treebld.geoms;
+    geoms.reserve(geoms.size() + m->triangleCount());
+    for (uint32_t i = 0; i < m->triangleCount(); ++i) {
+        geometry g(triangle(m.get(), 3 * i));
+        g.relIndex = relIndex;
+        geoms.push_back(g);
+    }
+    object.meshes.push_back(std::move(m));
+}
+
+void hittable_list::addInstance(bvh::blas const &object, transform tf) {
+    tlas.instances.push_back({tf, &object});
+}
+
 void hittable_list::add(constant_medium medium, color albedo) {
     cms.emplace_back(medium);
     cmAlbedos.emplace_back(albedo);
@@ -75,13 +269,13 @@ enum bool32 : uint32_t { True = 0xFFFFFFFFul, False = 0x0ul };
 // The compiler may be optimizing for the wrong case (not having a null pointer)
 // here, as well as the hitSelect result.
 color const *hittable_list::sampleConstantMediums(timed_ray const &ray,
-                                                  double const maxT,
-                                                  double *hit) const noexcept {
+                                                  real const maxT,
+                                                  real *hit) const noexcept {
     ZoneScoped;
     auto rayLength = ray.r.dir.length();
     color const *selected = nullptr;
 
-    double currentHit = infinity;
+    real currentHit = infinity;
 
     auto const minDist = minRayDist * rayLength;
     auto const maxDist = maxT * rayLength;
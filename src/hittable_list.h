@@ -11,12 +11,21 @@
 // <http://creativecommons.org/publicdomain/zero/1.0/>.
 //==============================================================================================
 
+#include <memory>
 #include <vector>
 
 #include "bvh.h"
+#include "compact_bvh.h"
 #include "constant_medium.h"
 #include "geometry.h"
 #include "hittable.h"
+#include "settings.h"
+#include "geometry_arrays.h"
+#include "instance.h"
+#include "light.h"
+#include "wide_bvh.h"
+
+struct scene_file;
 
 struct hittable_list {
     bvh::tree_builder treebld;
@@ -25,6 +34,30 @@ struct hittable_list {
     std::vector<constant_medium> cms{};
     std::vector<color> cmAlbedos{};
 
+    tree_layout layout = tree_layout::binary;
+    bvh::wide_tree wideTree;
+    bvh::compact_tree compactTree;
+    // Per-kind copies of treebld.geoms and selectGeoms, which is what the
+    // hit functions actually read.
+    geometry_arrays treeArrays;
+    geometry_arrays selectArrays;
+
+    // Meshes of the triangles in the tree. Shared because copies of the list
+    // point to the same vertices.
+    std::vector<std::shared_ptr<mesh>> meshes;
+
+    // Instanced geometry, see instance.h. Shared so that copies of the list
+    // keep pointing to the same objects.
+    std::vector<std::shared_ptr<bvh::blas>> blases;
+    bvh::tlas tlas;
+
+    // Set when the list was loaded from a scene file, whose tree is used
+    // instead of treebld.
+    std::shared_ptr<scene_file const> file;
+
+    // The emitters that can be sampled directly, built by prepare.
+    light_list lights;
+
     hittable_list() {}
     hittable_list(lightInfo object, geometry geom) {
         add(object, std::move(geom));
@@ -37,10 +70,39 @@ struct hittable_list {
     void addTree(lightInfo object, geometry geom);
     void add(constant_medium medium, color albedo);
 
+    // Adds every triangle of the mesh to the tree as a new root, with the
+    // same material. transformAll moves the mesh itself.
+    void add(lightInfo object, std::shared_ptr<mesh> m);
+
+    // Returns a new empty object to fill with addTo and place in the world
+    // with addInstance.
+    bvh::blas &addBlas();
+    // Same as addTree, but the geometry is in `object`'s space.
+    void addTo(bvh::blas &object, lightInfo info, geometry geom);
+    // Adds every triangle of the mesh to `object`, which keeps the mesh.
+    void addTo(bvh::blas &object, lightInfo info, std::shared_ptr<mesh> m);
+    void addInstance(bvh::blas const &object, transform tf);
+
+    // Can't be used once loaded from a scene file, which is mapped read only.
     void transformAll(transform tf);
 
-    std::pair<geometry_ptr, double> hitSelect(timed_ray const &r) const;
+    // Moves the bounded selectGeoms into a new root of the tree, then builds
+    // the per-kind geometry arrays, the structures used to traverse the tree
+    // with `s.layout`, the instance trees and the light list. Must be called
+    // again after any change to the geometries (including transformAll).
+    void prepare(settings const &s);
+
+    // treebld, or the tree of the scene file.
+    bvh::tree_view treeView() const;
+
+    std::pair<geometry_ptr, real> hitSelect(timed_ray const &r) const;
+    // hitSelect for every active lane of the packet. The tree is always
+    // traversed with the binary layout.
+    void hitSelect(ray_packet const &p, bvh::packet_hits &hits) const;
+    // Whether anything is hit in [minRayDist, maxT), e.g. between a point
+    // and a light. Mediums aren't taken into account.
+    bool occluded(timed_ray const &r, real maxT) const;
 
-    color const *sampleConstantMediums(timed_ray const &ray, double closestHit,
-                                       double *hit) const noexcept;
+    color const *sampleConstantMediums(timed_ray const &ray, real closestHit,
+                                       real *hit) const noexcept;
 };
@@ -0,0 +1,92 @@
+#include "instance.h"
+
+#include <span>
+#include <tracy/Tracy.hpp>
+
+#include "hittable.h"
+#include "interval.h"
+#include "trace_colors.h"
+
+namespace bvh {
+
+void blas::build(bool const blocks) {
+    ZoneScopedN("blas build");
+    treebld.finish(0);
+    arrays = geometry_arrays::build(treebld, blocks);
+}
+
+aabb blas::bounds() const {
+    aabb box = empty_aabb;
+    for (int root = 0; root < int(treebld.nodes.size());
+         root = treebld.node_ends[root]) {
+        box = aabb(box, treebld.boxes[root]);
+    }
+    return box;
+}
+
+void tlas::build() {
+    ZoneScopedN("tlas build");
+    treebld = {};
+    for (size_t i = 0; i < instances.size(); ++i) {
+        auto const &inst = instances[i];
+        geometry proxy(inst.tf.applyForward(inst.object->bounds()));
+        proxy.relIndex = int(i);
+        treebld.geoms.push_back(proxy);
+    }
+    if (!instances.empty()) treebld.finish(0);
+}
+
+// Instances of a leaf of the tlas.
+static std::span<geometry const> proxies(tree_builder const &bld, int node) {
+    auto const n = bld.nodes[node];
+    return {bld.geoms.data() + n.objectIndex, size_t(n.objectCount)};
+}
+
+// `r` in the object space of `inst`.
+static timed_ray toObject(instance const &inst, timed_ray const &r) {
+    return {ray(inst.tf.applyInverse(r.r.orig), inst.tf.rotateInverse(r.r.dir)),
+            r.time};
+}
+
+std::pair<geometry_ptr, real> tlas::hit(timed_ray const &r,
+                                        real closestHit) const noexcept {
+    ZoneNamedN(zone, "tlas hit", filters::treeHit);
+    geometry_ptr result = nullptr;
+
+    walk(treebld.boxes, treebld.node_ends.data(), treebld.nodes.data(), r.r,
+         closestHit, [&](int node) {
+             for (auto const &proxy : proxies(treebld, node)) {
+                 auto const &inst = instances[proxy.relIndex];
+                 // @perf the blas always uses the binary layout.
+                 auto [g, t] =
+                     tree(inst.object->treebld, inst.object->arrays)
+                         .hitBVH(toObject(inst, r), closestHit);
+                 if (!g) continue;
+                 result = g;
+                 result.instance = &inst.tf;
+                 closestHit = t;
+             }
+             return false;
+         });
+
+    return {result, closestHit};
+}
+
+bool tlas::occluded(timed_ray const &r, real const maxT) const noexcept {
+    ZoneNamedN(zone, "tlas occluded", filters::treeHit);
+
+    bool hit = false;
+    walk(treebld.boxes, treebld.node_ends.data(), treebld.nodes.data(), r.r,
+         maxT, [&](int node) {
+             for (auto const &proxy : proxies(treebld, node)) {
+                 auto const &inst = instances[proxy.relIndex];
+                 hit = tree(inst.object->treebld, inst.object->arrays)
+                           .occluded(toObject(inst, r), maxT);
+                 if (hit) break;
+             }
+             return hit;
+         });
+    return hit;
+}
+
+}  // namespace bvh
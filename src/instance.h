@@ -0,0 +1,57 @@
+#pragma once
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "aabb.h"
+#include "bvh.h"
+#include "geometry.h"
+#include "geometry_arrays.h"
+#include "ray.h"
+#include "transforms.h"
+
+namespace bvh {
+
+// Bottom level: geometries built once in their own (object) space, and
+// placed in the world by any number of instances.
+struct blas {
+    tree_builder treebld;
+    geometry_arrays arrays;
+    // Meshes of the triangles in treebld. They stay in object space, so
+    // they aren't in hittable_list::meshes, which transformAll moves.
+    std::vector<std::shared_ptr<mesh>> meshes;
+
+    constexpr bool built() const { return !treebld.nodes.empty(); }
+    // Builds the tree and the geometry arrays. Geometries can't be added
+    // afterwards.
+    void build(bool blocks);
+    aabb bounds() const;
+};
+
+struct instance {
+    // object to world.
+    transform tf;
+    blas const *object;
+};
+
+// Top level: a tree over the world space boxes of the instances. Rays that
+// reach an instance are moved into its object space and traverse its blas.
+// Transforms are rigid, so distances along the ray are the same in both
+// spaces.
+struct tlas {
+    std::vector<instance> instances;
+    // A box geometry per instance, with the instance index as relIndex.
+    tree_builder treebld;
+
+    constexpr bool empty() const { return instances.empty(); }
+    // Every blas must be built already.
+    void build();
+
+    std::pair<geometry_ptr, real> hit(timed_ray const &r,
+                                      real closestHit) const noexcept;
+    // Whether any instance is hit in [minRayDist, maxT).
+    bool occluded(timed_ray const &r, real maxT) const noexcept;
+};
+
+}  // namespace bvh
@@ -14,32 +14,33 @@
 
 #include "rtweekend.h"
 struct interval {
-    double min, max;
+    real min, max;
 
     constexpr interval()
         : min(+infinity), max(-infinity) {}  // Default interval is empty
 
-    constexpr interval(double min, double max) : min(min), max(max) {}
+    constexpr interval(real min, real max) : min(min), max(max) {}
 
     // Create the interval tightly enclosing the two input intervals.
     constexpr interval(interval const &a, interval const &b)
         : min(std::min(a.min, b.min)), max(std::max(a.max, b.max)) {}
 
-    constexpr double size() const { return max - min; }
+    constexpr real size() const { return max - min; }
     constexpr bool isEmpty() const { return min >= max; }
 
-    constexpr bool contains(double x) const { return min <= x && x <= max; }
+    constexpr bool contains(real x) const { return min <= x && x <= max; }
 
-    constexpr bool surrounds(double x) const { return min < x && x < max; }
-    constexpr bool atBorder(double x) const {
-        return std::abs(min - x) <= 1e-8 || std::abs(x - max) <= 1e-8;
+    constexpr bool surrounds(real x) const { return min < x && x < max; }
+    constexpr bool atBorder(real x) const {
+        return std::abs(min - x) <= surface_epsilon ||
+               std::abs(x - max) <= surface_epsilon;
     }
 
-    constexpr double clamp(double x) const { return std::clamp(x, min, max); }
+    constexpr real clamp(real x) const { return std::clamp(x, min, max); }
 
-    constexpr double midPoint() const { return min + (max - min) / 2.; }
+    constexpr real midPoint() const { return min + (max - min) / 2.; }
 
-    constexpr interval expand(double delta) const {
+    constexpr interval expand(real delta) const {
         auto padding = delta / 2;
         return interval(min - padding, max + padding);
     }
@@ -48,10 +49,10 @@ struct interval {
 static constexpr interval empty_interval = interval(+infinity, -infinity);
 static constexpr interval universe_interval = interval(-infinity, +infinity);
 
-constexpr interval operator+(interval ival, double displacement) {
+constexpr interval operator+(interval ival, real displacement) {
     return interval(ival.min + displacement, ival.max + displacement);
 }
 
-constexpr interval operator+(double displacement, interval ival) {
+constexpr interval operator+(real displacement, interval ival) {
     return ival + displacement;
 }
@@ -0,0 +1,184 @@
+#include "light.h"
+
+#include <algorithm>
+#include <cmath>
+#include <tracy/Tracy.hpp>
+
+#include "hittable_list.h"
+#include "rtweekend.h"
+#include "texture_impls.h"
+
+// Shadow rays stop this fraction short of the light, so that they don't hit
+// the light itself.
+static constexpr real shadowEpsilon =
+    sizeof(real) == sizeof(float) ? 1e-3 : 1e-6;
+
+void light_list::add(std::span<geometry const> geoms,
+                     std::span<lightInfo const> objects) {
+    byObject.resize(objects.size(), -1);
+    for (auto const &g : geoms) {
+        auto const &obj = objects[g.relIndex];
+        if (obj.mat.tag != material::kind::diffuse_light) continue;
+        if (g.kind != geometry_kind::quad && g.kind != geometry_kind::sphere) {
+            continue;
+        }
+        // @maybe an object made of several geometries would need a list.
+        if (byObject[g.relIndex] >= 0) continue;
+        byObject[g.relIndex] = int(lights.size());
+        lights.push_back({g, obj.tex});
+    }
+}
+
+// Density of the cone of directions from `from` to the sphere, or 0 from
+// inside it.
+static real coneDensity(sphere const &sph, point3 const &from, real time,
+                        real *oneMinusCos = nullptr) {
+    auto toCenter = sphere_center(sph, time) - from;
+    auto dist2 = toCenter.length_squared();
+    auto r2 = sph.radius * sph.radius;
+    if (dist2 <= r2) return 0;
+    // 1 - cos(max angle), without the cancellation of small spheres.
+    auto sin2Max = r2 / dist2;
+    auto a = sin2Max / (1 + std::sqrt(1 - sin2Max));
+    if (oneMinusCos) *oneMinusCos = a;
+    return 1 / (2 * pi * a);
+}
+
+bool light_list::sample(point3 const &from, real time, real pick, sample2 u,
+                        light_sample &out) const {
+    auto const count = int(lights.size());
+    auto const &l = lights[std::min(int(pick * count), count - 1)];
+    out.tex = l.tex;
+
+    switch (l.geom.kind) {
+        case geometry_kind::quad: {
+            auto const &q = l.geom.data.quad;
+            out.p = q.Q + u.x * q.u + u.y * q.v;
+            auto n = cross(q.u, q.v);
+            auto area = n.length();
+            out.normal = n / area;
+            out.uv = q.getUVs(out.p);
+
+            auto toLight = out.p - from;
+            auto dist2 = toLight.length_squared();
+            auto cosine = std::abs(dot(out.normal, toLight)) / std::sqrt(dist2);
+            if (cosine < 1e-6) return false;
+            out.pdf = dist2 / (cosine * area) / count;
+            return true;
+        }
+        case geometry_kind::sphere: {
+            // Uniform over the cone of directions that see the sphere,
+            // which unlike its area never picks the hidden half.
+            auto const &sph = l.geom.data.sphere;
+            real a;
+            auto density = coneDensity(sph, from, time, &a);
+            if (density == 0) return false;
+
+            auto center = sphere_center(sph, time);
+            auto toCenter = center - from;
+            auto dist = toCenter.length();
+            auto w = toCenter / dist;
+            vec3 t, b;
+            orthonormal_basis(w, t, b);
+
+            auto oneMinusCos = u.x * a;
+            auto cosTheta = 1 - oneMinusCos;
+            auto sin2Theta = oneMinusCos * (2 - oneMinusCos);
+            auto sinTheta = std::sqrt(sin2Theta);
+            auto phi = 2 * pi * u.y;
+            auto dir = sinTheta * std::cos(phi) * t +
+                       sinTheta * std::sin(phi) * b + cosTheta * w;
+
+            // the near side of the sphere along dir.
+            auto r2 = sph.radius * sph.radius;
+            auto along = dist * cosTheta -
+                         std::sqrt(std::max(real(0), r2 - dist * dist *
+                                                              sin2Theta));
+            out.p = from + along * dir;
+            out.normal = (out.p - center) / sph.radius;
+            out.uv = sphere::getUVs(out.normal);
+            out.pdf = density / count;
+            return true;
+        }
+        default:
+            break;
+    }
+    std::unreachable();
+}
+
+real light_list::pdf(int relIndex, point3 const &from, point3 const &p,
+                     real time) const {
+    auto index = byObject[relIndex];
+    if (index < 0) return 0;
+    auto const count = real(lights.size());
+    auto const &g = lights[index].geom;
+
+    switch (g.kind) {
+        case geometry_kind::quad: {
+            auto const &q = g.data.quad;
+            auto n = cross(q.u, q.v);
+            auto area = n.length();
+            auto toLight = p - from;
+            auto dist2 = toLight.length_squared();
+            auto cosine = std::abs(dot(n, toLight)) / (area * std::sqrt(dist2));
+            if (cosine < 1e-6) return 0;
+            return dist2 / (cosine * area) / count;
+        }
+        case geometry_kind::sphere:
+            return coneDensity(g.data.sphere, from, time) / count;
+        default:
+            return 0;
+    }
+}
+
+color direct_light(hittable_list const &world, point3 const &p,
+                   vec3 const &normal, real time, sampler const &smp,
+                   perlin const &noise) {
+    ZoneScopedN("direct light");
+    // drawn first, so that the dimensions used don't depend on the outcome.
+    auto pick = smp.get1D();
+    auto u = smp.get2D();
+
+    light_sample ls;
+    if (!world.lights.sample(p, time, pick, u, ls)) return color(0, 0, 0);
+
+    auto toLight = ls.p - p;
+    auto dist = toLight.length();
+    auto wi = toLight / dist;
+    auto cosine = dot(normal, wi);
+    if (cosine <= 0) return color(0, 0, 0);
+
+    // A medium on the way scatters the shadow ray as often as it would a
+    // bounce, which is the chance the light goes through.
+    timed_ray shadow{ray(p, wi), time};
+    auto maxT = dist * (1 - shadowEpsilon);
+    real scatterAt;
+    if (world.occluded(shadow, maxT) ||
+        world.sampleConstantMediums(shadow, maxT, &scatterAt)) {
+        return color(0, 0, 0);
+    }
+
+    auto bsdfPdf = cosine / pi;
+    auto emitted = sample_texture(ls.tex, ls.uv, ls.p, noise);
+    return emitted * (bsdfPdf * power_heuristic(ls.pdf, bsdfPdf) / ls.pdf);
+}
+
+next_event sample_next_event(settings const &s, hittable_list const &world,
+                             material::kind mat, point3 const &p,
+                             vec3 const &normal, vec3 const &scattered,
+                             real time, sampler const &smp,
+                             perlin const &noise) {
+    if (!s.light_sampling || world.lights.empty() ||
+        mat != material::kind::lambertian) {
+        return {color(0, 0, 0), 0};
+    }
+    return {direct_light(world, p, normal, time, smp, noise),
+            dot(normal, scattered) / pi};
+}
+
+real bounce_weight(hittable_list const &world, int relIndex,
+                   point3 const &from, point3 const &p, real time,
+                   real bsdfPdf) {
+    auto lightPdf = world.lights.pdf(relIndex, from, p, time);
+    return lightPdf > 0 ? power_heuristic(bsdfPdf, lightPdf) : 1;
+}
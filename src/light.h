@@ -0,0 +1,83 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "geometry.h"
+#include "hittable.h"
+#include "perlin.h"
+#include "sampler.h"
+
+struct hittable_list;
+
+// Emitter that next event estimation samples directly: a quad or a sphere
+// with the diffuse_light material. Other emitters are only found by bounces.
+struct light {
+    geometry geom;
+    texture const *tex;
+};
+
+// Point picked on a light, as seen from the shading point.
+struct light_sample {
+    point3 p;
+    vec3 normal;
+    uvs uv;
+    texture const *tex;
+    // Solid angle density around the shading point, selection included.
+    real pdf;
+};
+
+struct light_list {
+    std::vector<light> lights;
+    // Index in `lights` of each object of the world, or -1.
+    std::vector<int> byObject;
+
+    // Collects the lights among `geoms`, where `objects` is what their
+    // relIndex points to.
+    void add(std::span<geometry const> geoms,
+             std::span<lightInfo const> objects);
+
+    bool empty() const { return lights.empty(); }
+
+    // Picks a light with `pick` and a point on it with `u`. Returns false if
+    // nothing can be sampled from `from` (e.g. it is inside the sphere).
+    bool sample(point3 const &from, real time, real pick, sample2 u,
+                light_sample &out) const;
+    // Density of sample() choosing the point `p` of object `relIndex`, or 0
+    // when the object isn't one of the lights.
+    real pdf(int relIndex, point3 const &from, point3 const &p,
+             real time) const;
+};
+
+// Power heuristic weight of a strategy with density `pdf` against one with
+// density `other`.
+inline real power_heuristic(real pdf, real other) {
+    return pdf * pdf / (pdf * pdf + other * other);
+}
+
+// Light reaching the lambertian point `p` (with `normal` facing the incoming
+// ray) from a light sampled with `smp`, times the cosine over pi and the MIS
+// weight against the cosine sampled bounce. The albedo is left out, it's a
+// deferred attenuation. Black if the light is occluded.
+color direct_light(hittable_list const &world, point3 const &p,
+                   vec3 const &normal, real time, sampler const &smp,
+                   perlin const &noise);
+
+// Next event estimation after a bounce off `mat` at `p` towards `scattered`,
+// the part both pipelines share. Only lambertian bounces sample the lights,
+// and only with settings::light_sampling and lights in the world.
+struct next_event {
+    color direct;    // direct_light(), black when the lights aren't sampled
+    real bouncePdf;  // for bounce_weight() on the next hit, 0 if not needed
+};
+next_event sample_next_event(settings const &s, hittable_list const &world,
+                             material::kind mat, point3 const &p,
+                             vec3 const &normal, vec3 const &scattered,
+                             real time, sampler const &smp,
+                             perlin const &noise);
+
+// MIS weight of the emission of object `relIndex`, hit at `p` by a bounce
+// from the lambertian point `from` whose direction had density `bsdfPdf`.
+real bounce_weight(hittable_list const &world, int relIndex,
+                   point3 const &from, point3 const &p, real time,
+                   real bsdfPdf);
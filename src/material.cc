@@ -5,7 +5,7 @@
 
 #include <tracy/Tracy.hpp>
 
-static double reflectance(double cosine, double refraction_index) {
+static real reflectance(real cosine, real refraction_index) {
     // Use Schlick's approximation for reflectance.
     auto r0 = (1 - refraction_index) / (1 + refraction_index);
     r0 = r0 * r0;
@@ -14,26 +14,15 @@ static double reflectance(double cosine, double refraction_index) {
 static vec3 reflect(vec3 v, vec3 n) { return v - 2 * dot(v, n) * n; }
 
 // `uv`, `n` are assumed to be unit vectors.
-static vec3 refract(vec3 uv, vec3 n, double etai_over_etat) {
+static vec3 refract(vec3 uv, vec3 n, real etai_over_etat) {
     auto cos_theta = -dot(uv, n);
     vec3 r_out_perp = etai_over_etat * (uv + cos_theta * n);
     vec3 r_out_parallel =
         -std::sqrt(std::abs(1.0 - r_out_perp.length_squared())) * n;
     return r_out_perp + r_out_parallel;
 }
-static vec3 random_in_unit_sphere() {
-    while (true) {
-        auto p = random_vec(-1, 1);
-        if (p.length_squared() < 1) return p;
-    }
-}
-
-static vec3 random_unit_vector() {
-    return unit_vector(random_in_unit_sphere());
-}
-
 bool material::scatter(vec3 in_dir, vec3 const &normal, bool front_face,
-                       vec3 &scattered) const {
+                       sampler const &smp, vec3 &scattered) const {
     ZoneScopedN("scatter");
     ZoneColor(Ctp::Pink);
     switch (tag) {
@@ -42,24 +31,19 @@ bool material::scatter(vec3 in_dir, vec3 const &normal, bool front_face,
             return false;
         case kind::isotropic: {
             ZoneScopedN("isotropic scatter");
-            scattered = random_unit_vector();
+            scattered = uniform_sphere(smp.get2D());
             return true;
         }
         case kind::lambertian: {
             ZoneScopedN("lambertian scatter");
-            auto scatter_direction = normal + random_unit_vector();
-
-            // Catch degenerate scatter direction
-            if (scatter_direction.near_zero()) scatter_direction = normal;
-
-            scattered = scatter_direction;
+            scattered = cosine_hemisphere(normal, smp.get2D());
             return true;
         }
         case kind::metal: {
             auto fuzz = data.fuzz;
             ZoneScopedN("metal scatter");
             vec3 reflected = reflect(in_dir, normal);
-            auto fv = fuzz * random_unit_vector();
+            auto fv = fuzz * uniform_sphere(smp.get2D());
             reflected = unit_vector(reflected) + fv;
             scattered = reflected;
             return (dot(scattered, normal) > 0);
@@ -67,16 +51,16 @@ bool material::scatter(vec3 in_dir, vec3 const &normal, bool front_face,
         case kind::dielectric: {
             auto refraction_index = data.refraction_index;
             ZoneScopedN("dielectric scatter");
-            double ri =
+            real ri =
                 front_face ? (1.0 / refraction_index) : refraction_index;
 
             vec3 unit_direction = unit_vector(in_dir);
-            double cos_theta = -dot(unit_direction, normal);
+            real cos_theta = -dot(unit_direction, normal);
 
             bool cannot_refract = ri * ri * (1 - cos_theta * cos_theta) > 1.0;
             vec3 direction;
 
-            if (cannot_refract || reflectance(cos_theta, ri) > random_double())
+            if (cannot_refract || reflectance(cos_theta, ri) > smp.get1D())
                 direction = reflect(unit_direction, normal);
             else
                 direction = refract(unit_direction, normal, ri);
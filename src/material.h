@@ -11,6 +11,7 @@
 // <http://creativecommons.org/publicdomain/zero/1.0/>.
 //==============================================================================================
 
+#include "sampler.h"
 #include "vec3.h"
 
 struct material {
@@ -19,12 +20,12 @@ struct material {
         isotropic,
         lambertian,
         metal,
-        dielectric,
+        dielectric,  // last, see materialKinds in wavefront.cc
     } tag;
 
     union Data {
-        double refraction_index;
-        double fuzz;
+        real refraction_index;
+        real fuzz;
 
         // NOTE: These constructors and destructors allow me to construct
         // everything easily.
@@ -35,15 +36,15 @@ struct material {
     constexpr material(kind tag, Data const &data) : tag(tag), data(data) {}
 
     bool scatter(vec3 in_dir, vec3 const &normal, bool front_face,
-                 vec3 &scattered) const;
+                 sampler const &smp, vec3 &scattered) const;
 
-    static constexpr material metal(double fuzz) {
+    static constexpr material metal(real fuzz) {
         Data d;
         d.fuzz = fuzz;
         return material(material::kind::metal, d);
     }
 
-    static constexpr material dielectric(double ir) {
+    static constexpr material dielectric(real ir) {
         Data d;
         d.refraction_index = ir;
         return material(material::kind::dielectric, d);
@@ -0,0 +1,346 @@
+// rt-microbench: times the intersection and noise kernels on their own, over
+// fixed batches of synthetic rays with a given fraction of hits. Also checks
+// that the samplers aren't biased, and exits with 1 if one is.
+//
+//   rt-microbench [--filter <substring>] [--min-time <seconds>]
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <format>
+#include <print>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "aabb.h"
+#include "bvh.h"
+#include "compact_bvh.h"
+#include "geometry.h"
+#include "geometry_arrays.h"
+#include "perlin.h"
+#include "quad.h"
+#include "random.h"
+#include "ray.h"
+#include "sampler.h"
+#include "sphere.h"
+#include "texture.h"
+#include "texture_impls.h"
+#include "triangle.h"
+#include "wide_bvh.h"
+
+static constexpr int batchSize = 4096;
+static constexpr unsigned int batchSeed = 7;
+static constexpr double hitRatios[] = {0, 0.5, 1};
+
+// Results are added here so that the kernels aren't optimized out.
+static volatile real sink;
+
+static std::string_view filter;
+static std::chrono::duration<double> minTime{0.25};
+
+// Runs `kernel` (one call per ray of the batch) until it took minTime, and
+// prints the average time of a call.
+template <typename F>
+static void run(std::string const &name, F &&kernel) {
+    if (name.find(filter) == std::string::npos) return;
+    using clock = std::chrono::steady_clock;
+
+    kernel();  // warm up
+    for (long iterations = 1;; iterations *= 2) {
+        auto start = clock::now();
+        for (long i = 0; i < iterations; ++i) kernel();
+        std::chrono::duration<double> elapsed = clock::now() - start;
+        if (elapsed < minTime && iterations < (1l << 30)) continue;
+
+        auto calls = double(iterations) * batchSize;
+        std::println("{:<36} {:>10.2f} ns {:>10.2f} Mcalls/s {:>12}", name,
+                     elapsed.count() / calls * 1e9,
+                     calls / elapsed.count() * 1e-6, iterations);
+        return;
+    }
+}
+
+// Rays from around (0, 0, -5) towards the unit object at the origin. A ray
+// hits when it aims at [-0.5, 0.5]^3, otherwise it aims 4 units to the side.
+static std::vector<timed_ray> unitRays(double hitRatio) {
+    seed_random(batchSeed);
+    std::vector<timed_ray> rays;
+    rays.reserve(batchSize);
+    for (int i = 0; i < batchSize; ++i) {
+        auto orig = point3(random_double() - 0.5, random_double() - 0.5, -5);
+        auto target = random_vec(-0.5, 0.5);
+        if (i >= hitRatio * batchSize) target += vec3(4, 0, 0);
+        rays.push_back({ray(orig, target - orig), random_double()});
+    }
+    // hits and misses interleaved, so that branches aren't trivially
+    // predicted.
+    for (int i = batchSize - 1; i > 0; --i) {
+        std::swap(rays[i], rays[int(random_double() * (i + 1))]);
+    }
+    return rays;
+}
+
+static std::string label(char const *kernel, double hitRatio) {
+    return std::format("{}/hits:{}%", kernel, int(hitRatio * 100));
+}
+
+static void unitKernels() {
+    sphere const sph(point3(0, 0, 0), 1);
+    quad const q(point3(-1, -1, 0), vec3(2, 0, 0), vec3(0, 2, 0));
+    aabb const box(point3(-1, -1, -1), point3(1, 1, 1));
+    auto const travSphere = traversable_geometry::from_geometry(sph);
+    auto const travBox = traversable_geometry::from_geometry(box);
+
+    // The same square as `q`, as a fan of 4 triangles around its center, so
+    // that one triangle_block holds all of them.
+    mesh square;
+    square.vertices = {point3(0, 0, 0), point3(-1, -1, 0), point3(1, -1, 0),
+                       point3(1, 1, 0), point3(-1, 1, 0)};
+    square.indices = {0, 1, 2, 0, 2, 3, 0, 3, 4, 0, 4, 1};
+    std::vector<triangle> triangles;
+    for (uint32_t i = 0; i < square.triangleCount(); ++i) {
+        triangles.emplace_back(&square, 3 * i);
+    }
+    auto const block = triangle_block::build(triangles)[0];
+
+    for (auto ratio : hitRatios) {
+        auto rays = unitRays(ratio);
+        run(label("sphere::hit", ratio), [&] {
+            real sum = 0;
+            for (auto const &r : rays) sum += sph.hit(r);
+            sink = sum;
+        });
+        run(label("quad::hit", ratio), [&] {
+            real sum = 0;
+            for (auto const &r : rays) sum += q.hit(r.r);
+            sink = sum;
+        });
+        run(label("triangle::hit/4 triangles", ratio), [&] {
+            real sum = 0;
+            for (auto const &r : rays) {
+                for (auto const &t : triangles) sum += t.hit(r.r);
+            }
+            sink = sum;
+        });
+        run(label("triangle_block::hit", ratio), [&] {
+            auto const maxT = simd::broadcast(infinity);
+            real sum = 0;
+            for (auto const &r : rays) {
+                sum += simd::bits(simd::less(block.hit(r, maxT), maxT));
+            }
+            sink = sum;
+        });
+        run(label("aabb::hit", ratio), [&] {
+            real sum = 0;
+            for (auto const &r : rays) sum += box.hit(r.r);
+            sink = sum;
+        });
+        run(label("aabb::traverse", ratio), [&] {
+            real sum = 0;
+            for (auto const &r : rays) sum += box.traverse(r.r).min;
+            sink = sum;
+        });
+        run(label("traversable_geometry::traverse/sphere", ratio), [&] {
+            real sum = 0;
+            for (auto const &r : rays) sum += travSphere.traverse(r).min;
+            sink = sum;
+        });
+        run(label("traversable_geometry::traverse/box", ratio), [&] {
+            real sum = 0;
+            for (auto const &r : rays) sum += travBox.traverse(r).min;
+            sink = sum;
+        });
+    }
+}
+
+// Rays from z = -30 towards the center of a random sphere of the scene for
+// hits, or towards points beside the scene for misses.
+static std::vector<timed_ray> sceneRays(std::vector<geometry> const &geoms,
+                                        double hitRatio) {
+    seed_random(batchSeed);
+    std::vector<timed_ray> rays;
+    rays.reserve(batchSize);
+    for (int i = 0; i < batchSize; ++i) {
+        auto orig = point3(random_double(-10, 10), random_double(-10, 10), -30);
+        point3 target;
+        if (i < hitRatio * batchSize) {
+            auto const &g = geoms[size_t(random_double() * geoms.size())];
+            target = g.data.sphere.center1;
+        } else {
+            target = point3(random_double(30, 40), random_double(-10, 10), 0);
+        }
+        rays.push_back({ray(orig, target - orig), 0});
+    }
+    for (int i = batchSize - 1; i > 0; --i) {
+        std::swap(rays[i], rays[int(random_double() * (i + 1))]);
+    }
+    return rays;
+}
+
+static void treeKernels() {
+    static constexpr int sphereCount = 10000;
+    seed_random(batchSeed);
+    bvh::tree_builder bld;
+    for (int i = 0; i < sphereCount; ++i) {
+        geometry g = sphere(random_vec(-10, 10), 0.1);
+        g.relIndex = i;
+        bld.geoms.push_back(g);
+    }
+    auto const geoms = bld.geoms;  // finish reorders them.
+    bld.finish(0);
+    auto const arrays = geometry_arrays::build(bld, true);
+    auto const wide = bvh::wide_tree::collapse(bld, arrays);
+    auto const compact = bvh::compact_tree::quantize(wide);
+
+    for (auto ratio : hitRatios) {
+        auto rays = sceneRays(geoms, ratio);
+        run(label("bvh::tree::hitBVH", ratio), [&] {
+            bvh::tree const tree(bld, arrays);
+            real sum = 0;
+            for (auto const &r : rays) sum += tree.hitBVH(r, infinity).second;
+            sink = sum;
+        });
+        run(label("bvh::wide_tree::hitBVH", ratio), [&] {
+            real sum = 0;
+            for (auto const &r : rays) {
+                sum += wide.hitBVH(arrays, r, infinity).second;
+            }
+            sink = sum;
+        });
+        run(label("bvh::compact_tree::hitBVH", ratio), [&] {
+            real sum = 0;
+            for (auto const &r : rays) {
+                sum += compact.hitBVH(arrays, r, infinity).second;
+            }
+            sink = sum;
+        });
+        // Shadow queries that stop at the ray targets (t = 1).
+        run(label("bvh::tree::occluded", ratio), [&] {
+            bvh::tree const tree(bld, arrays);
+            real sum = 0;
+            for (auto const &r : rays) sum += tree.occluded(r, 1);
+            sink = sum;
+        });
+        run(label("bvh::wide_tree::occluded", ratio), [&] {
+            real sum = 0;
+            for (auto const &r : rays) sum += wide.occluded(arrays, r, 1);
+            sink = sum;
+        });
+        run(label("bvh::compact_tree::occluded", ratio), [&] {
+            real sum = 0;
+            for (auto const &r : rays) sum += compact.occluded(arrays, r, 1);
+            sink = sum;
+        });
+    }
+}
+
+static void noiseKernels() {
+    perlin const noise;
+    seed_random(batchSeed);
+    std::vector<point3> points;
+    points.reserve(batchSize);
+    for (int i = 0; i < batchSize; ++i) points.push_back(random_vec(-50, 50));
+
+    for (real scale : {0.2, 4.0}) {
+        texture::noise_data const data{scale};
+        run(std::format("sample_noise/scale:{}", scale), [&] {
+            real sum = 0;
+            for (auto const &p : points) sum += sample_noise(data, p, noise);
+            sink = sum;
+        });
+    }
+
+    std::vector<real> turbs(points.size());
+    run("perlin::turb", [&] {
+        real sum = 0;
+        for (auto const &p : points) sum += noise.turb(p, noiseDepth);
+        sink = sum;
+    });
+    run("perlin::turb_batch", [&] {
+        noise.turb_batch(points, noiseDepth, turbs);
+        sink = turbs.back();
+    });
+}
+
+static constexpr std::pair<char const *, sampler_kind> samplerKinds[] = {
+    {"independent", sampler_kind::independent},
+    {"stratified", sampler_kind::stratified},
+    {"sobol", sampler_kind::sobol},
+    {"rank1", sampler_kind::rank1},
+};
+
+static void samplerKernels() {
+    for (auto [name, kind] : samplerKinds) {
+        sampler const smp{kind, batchSize, 64};
+        run(std::format("sampler::get2D/{}", name), [&] {
+            real sum = 0;
+            for (int i = 0; i < batchSize; ++i) {
+                rng::begin_sample(batchSeed, 0, uint32_t(i));
+                auto u = smp.get2D();
+                sum += u.x + u.y;
+            }
+            sink = sum;
+        });
+    }
+}
+
+// Not a timing: the mean of get2D() over many pixels must be 1/2 on both
+// axes for every kind, whether the sample count is a square or not (an
+// uneven stratified grid would pull it down). Returns whether it is.
+static bool samplerMeans() {
+    static constexpr uint32_t pixels = 4000;
+    static constexpr double tolerance = 0.01;
+    bool ok = true;
+    for (auto [name, kind] : samplerKinds) {
+        for (int spp : {10, 16, 200}) {
+            auto kernel =
+                std::format("sampler::get2D/{}/spp:{}/mean", name, spp);
+            if (kernel.find(filter) == std::string::npos) continue;
+            sampler const smp{kind, spp, 64};
+            double sumx = 0, sumy = 0;
+            for (uint32_t pixel = 0; pixel < pixels; ++pixel) {
+                for (int i = 0; i < spp; ++i) {
+                    rng::begin_sample(batchSeed, pixel, uint32_t(i));
+                    auto u = smp.get2D();
+                    sumx += u.x;
+                    sumy += u.y;
+                }
+            }
+            auto const count = double(pixels) * spp;
+            auto const mx = sumx / count, my = sumy / count;
+            bool const good = std::abs(mx - 0.5) < tolerance &&
+                              std::abs(my - 0.5) < tolerance;
+            ok = ok && good;
+            std::println("{:<36} x {:.4f} y {:.4f}{}", kernel, mx, my,
+                         good ? "" : "  BIASED");
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        bool const hasValue = i + 1 < argc;
+        if (arg == "--filter" && hasValue) {
+            filter = argv[++i];
+        } else if (arg == "--min-time" && hasValue) {
+            minTime = std::chrono::duration<double>(std::atof(argv[++i]));
+        } else {
+            std::println(stderr,
+                         "usage: rt-microbench [--filter <substring>] "
+                         "[--min-time <seconds>]");
+            return 1;
+        }
+    }
+
+    std::println("{:<36} {:>13} {:>19} {:>12}", "kernel", "time/call",
+                 "throughput", "iterations");
+    unitKernels();
+    treeKernels();
+    noiseKernels();
+    samplerKernels();
+    return samplerMeans() ? 0 : 1;
+}
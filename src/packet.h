@@ -0,0 +1,38 @@
+#pragma once
+
+#include "ray.h"
+#include "simd.h"
+
+// Rays that are traversed together, one per lane. Meant for coherent rays
+// (e.g. the camera rays of a pixel), which visit mostly the same nodes, so
+// that each node fetch is shared by all of them.
+struct ray_packet {
+    static constexpr int width = simd::width;
+
+    alignas(32) real ox[width];
+    alignas(32) real oy[width];
+    alignas(32) real oz[width];
+    alignas(32) real dx[width];
+    alignas(32) real dy[width];
+    alignas(32) real dz[width];
+    alignas(32) real time[width];
+
+    // One bit per lane that carries a ray.
+    int active = 0;
+
+    void set(int lane, timed_ray const &r) {
+        ox[lane] = r.r.orig.x();
+        oy[lane] = r.r.orig.y();
+        oz[lane] = r.r.orig.z();
+        dx[lane] = r.r.dir.x();
+        dy[lane] = r.r.dir.y();
+        dz[lane] = r.r.dir.z();
+        time[lane] = r.time;
+        active |= 1 << lane;
+    }
+
+    timed_ray lane(int i) const {
+        return {ray(point3(ox[i], oy[i], oz[i]), vec3(dx[i], dy[i], dz[i])),
+                time[i]};
+    }
+};
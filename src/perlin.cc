@@ -1,11 +1,16 @@
 #include "perlin.h"
 
+#include <algorithm>
+#include <cassert>
+#include <tracy/Tracy.hpp>
+
 #include "rtweekend.h"
+#include "simd.h"
 
 static constexpr int point_count = 256;
 
-static double perlin_interp(vec3 const c[2][2][2], double u, double v,
-                            double w) {
+static real perlin_interp(vec3 const c[2][2][2], real u, real v,
+                          real w) {
     auto uu = u * u * (3 - 2 * u);
     auto vv = v * v * (3 - 2 * v);
     auto ww = w * w * (3 - 2 * w);
@@ -40,15 +45,19 @@ static void perlin_generate_perm(int (*p)[point_count]) {
 }
 
 perlin::perlin() {
+    real coords[3 * point_count];
+    random_fill(coords);
     for (int i = 0; i < point_count; i++) {
-        randvec[i] = unit_vector(random_vec(-1, 1));
+        auto const *u = coords + 3 * i;
+        randvec[i] = unit_vector(
+            vec3(2 * u[0] - 1, 2 * u[1] - 1, 2 * u[2] - 1));
     }
 
     perlin_generate_perm(&perm_x);
     perlin_generate_perm(&perm_y);
     perlin_generate_perm(&perm_z);
 }
-double perlin::noise(point3 const &p) const {
+real perlin::noise(point3 const &p) const {
     auto u = p.x() - floor(p.x());
     auto v = p.y() - floor(p.y());
     auto w = p.z() - floor(p.z());
@@ -68,7 +77,7 @@ double perlin::noise(point3 const &p) const {
     return perlin_interp(c, u, v, w);
 }
 
-double perlin::turb(point3 const &p, int depth) const {
+real perlin::turb(point3 const &p, int depth) const {
     auto accum = 0.0;
     auto temp_p = p;
     auto weight = 1.0;
@@ -81,3 +90,100 @@ double perlin::turb(point3 const &p, int depth) const {
 
     return fabs(accum);
 }
+
+// perlin::noise of the 4 points in the lanes of x, y and z.
+static simd::v4 noise4(perlin const &pn, simd::v4 x, simd::v4 y, simd::v4 z) {
+    auto fx = simd::floor(x);
+    auto fy = simd::floor(y);
+    auto fz = simd::floor(z);
+    auto u = x - fx;
+    auto v = y - fy;
+    auto w = z - fz;
+
+    // The permuted lattice coordinates of both corners of the cell on each
+    // axis, shared by the 8 corners.
+    auto const mask = simd::broadcast_int(point_count - 1);
+    auto const one = simd::broadcast_int(1);
+    auto i = simd::to_int(fx);
+    auto j = simd::to_int(fy);
+    auto k = simd::to_int(fz);
+    simd::i4 const px[2] = {
+        simd::gather(pn.perm_x, simd::bit_and(i, mask)),
+        simd::gather(pn.perm_x, simd::bit_and(simd::add(i, one), mask))};
+    simd::i4 const py[2] = {
+        simd::gather(pn.perm_y, simd::bit_and(j, mask)),
+        simd::gather(pn.perm_y, simd::bit_and(simd::add(j, one), mask))};
+    simd::i4 const pz[2] = {
+        simd::gather(pn.perm_z, simd::bit_and(k, mask)),
+        simd::gather(pn.perm_z, simd::bit_and(simd::add(k, one), mask))};
+
+    // NOTE: @cutnpaste from perlin_interp, with the corner weights picked
+    // instead of computed.
+    auto const ones = simd::broadcast(1);
+    auto const twos = simd::broadcast(2);
+    auto const threes = simd::broadcast(3);
+    auto uu = u * u * (threes - twos * u);
+    auto vv = v * v * (threes - twos * v);
+    auto ww = w * w * (threes - twos * w);
+    simd::v4 const wx[2] = {ones - uu, uu};
+    simd::v4 const wy[2] = {ones - vv, vv};
+    simd::v4 const wz[2] = {ones - ww, ww};
+    simd::v4 const dx[2] = {u, u - ones};
+    simd::v4 const dy[2] = {v, v - ones};
+    simd::v4 const dz[2] = {w, w - ones};
+
+    real const *rv = pn.randvec[0].e;
+    auto accum = simd::broadcast(0);
+    for (int di = 0; di < 2; di++)
+        for (int dj = 0; dj < 2; dj++)
+            for (int dk = 0; dk < 2; dk++) {
+                auto h = simd::bit_xor(simd::bit_xor(px[di], py[dj]), pz[dk]);
+                // randvec is an array of 3 reals.
+                auto at = simd::add(h, simd::add(h, h));
+                auto d = simd::gather(rv, at) * dx[di] +
+                         simd::gather(rv + 1, at) * dy[dj] +
+                         simd::gather(rv + 2, at) * dz[dk];
+                accum = accum + wx[di] * wy[dj] * wz[dk] * d;
+            }
+    return accum;
+}
+
+void perlin::turb_batch(std::span<point3 const> points, int depth,
+                        std::span<real> out) const {
+    ZoneScopedN("turb batch");
+    assert(points.size() == out.size());
+    static constexpr size_t width = simd::width;
+    static_assert(sizeof(vec3) == 3 * sizeof(real));
+
+    for (size_t first = 0; first < points.size(); first += width) {
+        // the last lanes of the tail are padded with the origin.
+        auto const count = std::min(width, points.size() - first);
+        alignas(32) real xs[width] = {};
+        alignas(32) real ys[width] = {};
+        alignas(32) real zs[width] = {};
+        for (size_t lane = 0; lane < count; ++lane) {
+            auto const &p = points[first + lane];
+            xs[lane] = p.x();
+            ys[lane] = p.y();
+            zs[lane] = p.z();
+        }
+        auto x = simd::load(xs);
+        auto y = simd::load(ys);
+        auto z = simd::load(zs);
+
+        // NOTE: @cutnpaste from turb.
+        auto accum = simd::broadcast(0);
+        real weight = 1;
+        for (int octave = 0; octave < depth; ++octave) {
+            accum = accum + simd::broadcast(weight) * noise4(*this, x, y, z);
+            weight *= 0.5;
+            x = x + x;
+            y = y + y;
+            z = z + z;
+        }
+
+        alignas(32) real res[width];
+        simd::store(res, simd::abs(accum));
+        std::copy_n(res, count, out.begin() + first);
+    }
+}
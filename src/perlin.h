@@ -11,6 +11,8 @@
 // <http://creativecommons.org/publicdomain/zero/1.0/>.
 //==============================================================================================
 
+#include <span>
+
 #include "vec3.h"
 
 struct perlin {
@@ -18,9 +20,13 @@ struct perlin {
 
     perlin();
 
-    double noise(point3 const &p) const;
+    real noise(point3 const &p) const;
 
-    double turb(point3 const &p, int depth) const;
+    real turb(point3 const &p, int depth) const;
+    // turb of every point, into `out` (of the same size). Runs 4 points at a
+    // time, so it's much faster than calling turb for each one.
+    void turb_batch(std::span<point3 const> points, int depth,
+                    std::span<real> out) const;
 
     vec3 randvec[point_count];
     int perm_x[point_count];
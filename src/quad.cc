@@ -21,7 +21,7 @@ uvs quad::getUVs(point3 intersection) const {
     return uv;
 }
 
-static bool is_interior(double a, double b) {
+static bool is_interior(real a, real b) {
     static constexpr interval unit_interval = interval(0, 1);
     // Given the hit point in plane coordinates, return false if it is
     // outside the primitive, otherwise set the hit record UV coordinates
@@ -32,7 +32,7 @@ static bool is_interior(double a, double b) {
 
 // @perf length(u) == length(v)?
 // @perf dot(u,v ) == 0.
-double quad::hit(ray const r) const {
+real quad::hit(ray const r) const {
     ZoneNamedN(_tracy, "quad hit", filters::hit);
     auto n = cross(u, v);
     auto normal = unit_vector(n);
@@ -30,7 +30,7 @@ struct quad {
         return aabb(bbox_diagonal1, bbox_diagonal2);
     }
 
-    double hit(ray r) const;
+    real hit(ray r) const;
 
     uvs getUVs(point3 intersection) const;
     vec3 getNormal() const;
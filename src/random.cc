@@ -1,38 +1,157 @@
 #include "random.h"
 
 
+#include <immintrin.h>
+
+#include <cmath>
+#include <cstdint>
+
 #include "rtweekend.h"
 #include "vec3.h"
 
-// Adapted from glibc/glibc/stdlib/rand_r.c
-/* This algorithm is mentioned in the ISO C standard, here extended
-   for 32 bits.  */
-static int next_rand(unsigned int *seed) {
-    unsigned int next = *seed;
-    int result;
-    next *= 1103515245;
-    next += 12345;
-    result = (unsigned int)(next / 65536) % 2048;
-    next *= 1103515245;
-    next += 12345;
-    result <<= 10;
-    result ^= (unsigned int)(next / 65536) % 1024;
-    next *= 1103515245;
-    next += 12345;
-    result <<= 10;
-    result ^= (unsigned int)(next / 65536) % 1024;
-    *seed = next;
-    return result;
+// Philox 4x32-10, from "Parallel random numbers: as easy as 1, 2, 3"
+// (Salmon et al. 2011).
+static constexpr uint32_t philoxM0 = 0xD2511F53;
+static constexpr uint32_t philoxM1 = 0xCD9E8D57;
+static constexpr uint32_t philoxW0 = 0x9E3779B9;
+static constexpr uint32_t philoxW1 = 0xBB67AE85;
+static constexpr int philoxRounds = 10;
+
+void rng::philox(counter c, uint64_t key, uint32_t out[4]) noexcept {
+    uint32_t x0 = c.pixel, x1 = c.sample, x2 = c.bounce,
+             x3 = c.dimension / 4;
+    auto k0 = uint32_t(key), k1 = uint32_t(key >> 32);
+    for (int round = 0; round < philoxRounds; ++round) {
+        auto p0 = uint64_t(philoxM0) * x0;
+        auto p1 = uint64_t(philoxM1) * x2;
+        auto y0 = uint32_t(p1 >> 32) ^ x1 ^ k0;
+        auto y2 = uint32_t(p0 >> 32) ^ x3 ^ k1;
+        x1 = uint32_t(p1);
+        x3 = uint32_t(p0);
+        x0 = y0;
+        x2 = y2;
+        k0 += philoxW0;
+        k1 += philoxW1;
+    }
+    out[0] = x0;
+    out[1] = x1;
+    out[2] = x2;
+    out[3] = x3;
+}
+
+real rng::uniform(counter c, uint64_t key) noexcept {
+    uint32_t block[4];
+    philox(c, key, block);
+    return to_unit(block[c.dimension % 4]);
+}
+
+// High and low halves of the 32 bit products m * x for the 8 lanes.
+static void mulhilo8(__m256i x, __m256i m, __m256i &hi, __m256i &lo) {
+    auto even = _mm256_mul_epu32(x, m);
+    auto odd = _mm256_mul_epu32(_mm256_srli_epi64(x, 32), m);
+    lo = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+    hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+}
+
+// philox() for blocks [block, block + 8) of the same bounce.
+static void philox8(rng::counter c, uint32_t block, uint64_t key,
+                    uint32_t out[32]) {
+    auto x0 = _mm256_set1_epi32(int(c.pixel));
+    auto x1 = _mm256_set1_epi32(int(c.sample));
+    auto x2 = _mm256_set1_epi32(int(c.bounce));
+    auto x3 = _mm256_add_epi32(_mm256_set1_epi32(int(block)),
+                               _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    auto const m0 = _mm256_set1_epi32(int(philoxM0));
+    auto const m1 = _mm256_set1_epi32(int(philoxM1));
+    auto k0 = uint32_t(key), k1 = uint32_t(key >> 32);
+    for (int round = 0; round < philoxRounds; ++round) {
+        __m256i hi0, lo0, hi1, lo1;
+        mulhilo8(x0, m0, hi0, lo0);
+        mulhilo8(x2, m1, hi1, lo1);
+        x0 = _mm256_xor_si256(_mm256_xor_si256(hi1, x1),
+                              _mm256_set1_epi32(int(k0)));
+        x2 = _mm256_xor_si256(_mm256_xor_si256(hi0, x3),
+                              _mm256_set1_epi32(int(k1)));
+        x1 = lo1;
+        x3 = lo0;
+        k0 += philoxW0;
+        k1 += philoxW1;
+    }
+
+    // back to 4 consecutive words per block.
+    alignas(32) uint32_t w[4][8];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(w[0]), x0);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(w[1]), x1);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(w[2]), x2);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(w[3]), x3);
+    for (int b = 0; b < 8; ++b) {
+        for (int k = 0; k < 4; ++k) out[4 * b + k] = w[k][b];
+    }
+}
+
+void rng::fill(counter first, uint64_t key, std::span<real> out) noexcept {
+    size_t i = 0;
+    // up to the first whole block.
+    for (; i < out.size() && (first.dimension + i) % 4 != 0; ++i) {
+        auto c = first;
+        c.dimension += uint32_t(i);
+        out[i] = uniform(c, key);
+    }
+    uint32_t words[32];
+    for (; i + 32 <= out.size(); i += 32) {
+        philox8(first, uint32_t((first.dimension + i) / 4), key, words);
+        for (int k = 0; k < 32; ++k) out[i + k] = to_unit(words[k]);
+    }
+    for (; i < out.size(); ++i) {
+        auto c = first;
+        c.dimension += uint32_t(i);
+        out[i] = uniform(c, key);
+    }
 }
 
 // Since it's got a thread local static, we should only have one per thread.
 // Having one per cc file that uses random util is just wasteful.
-double random_double() {
-    static thread_local unsigned int seed = 0;
-    return double(next_rand(&seed) & RAND_MAX) / (double(RAND_MAX) + 1);
+static thread_local rng::stream threadStream;
+
+rng::stream &rng::current() noexcept { return threadStream; }
+
+void rng::begin_sample(uint64_t key, uint32_t pixel,
+                       uint32_t sample) noexcept {
+    threadStream.key = key;
+    threadStream.c = {pixel, sample, 0, 0};
+    threadStream.blockIndex = ~0u;
+}
+
+void rng::next_bounce() noexcept {
+    ++threadStream.c.bounce;
+    threadStream.c.dimension = 0;
+    threadStream.blockIndex = ~0u;
+}
+
+void rng::skip(uint32_t count) noexcept { threadStream.c.dimension += count; }
+
+// The sample index no render uses, so that these never repeat a sample's
+// numbers.
+void seed_random(unsigned int s) { rng::begin_sample(0, s, ~0u); }
+
+real random_double() {
+    auto &st = threadStream;
+    // Draws a block only when the dimension moves into a new one, also
+    // after a skip().
+    if (st.c.dimension / 4 != st.blockIndex) {
+        rng::philox(st.c, st.key, st.block);
+        st.blockIndex = st.c.dimension / 4;
+    }
+    return rng::to_unit(st.block[st.c.dimension++ % 4]);
+}
+
+void random_fill(std::span<real> out) {
+    auto &st = threadStream;
+    rng::fill(st.c, st.key, out);
+    st.c.dimension += uint32_t(out.size());
 }
 
-vec3 random_vec(double min, double max) {
+vec3 random_vec(real min, real max) {
     return vec3(random_double(min, max), random_double(min, max),
                 random_double(min, max));
 }
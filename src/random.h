@@ -1,7 +1,75 @@
 #pragma once
 
+#include <cstdint>
+#include <span>
+
 #include "vec3.h"
 
 
-double random_double();
-vec3 random_vec(double min = 0., double max = 1.);
+// Next number of the calling thread's rng::stream, in [0, 1).
+real random_double();
+// Restarts the sequence of the calling thread, e.g. to build the same scene
+// every time. Renders pick their streams with rng::begin_sample instead.
+void seed_random(unsigned int seed);
+vec3 random_vec(real min = 0., real max = 1.);
+// Same numbers as out.size() calls to random_double(), drawn with
+// rng::fill.
+void random_fill(std::span<real> out);
+
+// Counter based generator (Philox 4x32-10). Every number is a pure function
+// of a key and of its counter, so a sample gets the same numbers whatever
+// thread renders it, and in whatever order.
+namespace rng {
+
+struct counter {
+    uint32_t pixel;
+    uint32_t sample;
+    uint32_t bounce;
+    uint32_t dimension;  // index of the number within the bounce
+};
+
+// [0, 1) from the top bits, as many as fit in the mantissa so that it never
+// rounds up to 1.
+inline real to_unit(uint32_t bits) noexcept {
+    if constexpr (sizeof(real) == sizeof(float)) {
+        return real(bits >> 8) * 0x1p-24f;
+    } else {
+        return real(bits) * 0x1p-32;
+    }
+}
+
+// 4 random words for counter {pixel, sample, bounce, block}.
+void philox(counter c, uint64_t key, uint32_t out[4]) noexcept;
+
+// The number of dimension c.dimension of the bounce.
+real uniform(counter c, uint64_t key) noexcept;
+// Same as uniform() for dimensions [first.dimension, first.dimension +
+// out.size()), 8 blocks at a time with AVX2.
+void fill(counter first, uint64_t key, std::span<real> out) noexcept;
+
+// What random_double() draws from: a counter whose dimension goes up on
+// every call, and the block of 4 numbers it's in.
+struct stream {
+    uint64_t key = 0;
+    counter c{0, ~0u, 0, 0};
+    // c.dimension / 4 of the numbers in `block`, ~0u when they aren't from
+    // the current bounce.
+    uint32_t blockIndex = ~0u;
+    uint32_t block[4];
+};
+
+// The stream of the calling thread. Paths that are suspended between calls
+// (e.g. in the wavefront renderer) keep theirs and swap them in.
+stream &current() noexcept;
+
+// Makes the calling thread draw from bounce 0 of sample `sample` of pixel
+// `pixel`.
+void begin_sample(uint64_t key, uint32_t pixel, uint32_t sample) noexcept;
+// Moves on to dimension 0 of the next bounce, so the numbers of a bounce
+// don't depend on how many the previous ones used.
+void next_bounce() noexcept;
+// Moves the calling thread on by `count` dimensions without drawing them,
+// for samplers that only need to know which dimension they are at.
+void skip(uint32_t count) noexcept;
+
+}  // namespace rng
@@ -23,7 +23,7 @@ struct ray {
     constexpr ray() = default;
     constexpr ray(point3 orig, vec3 dir) : orig(orig), dir(dir) {}
 
-    point3 at(double t) const { return orig + t * dir; }
+    point3 at(real t) const { return orig + t * dir; }
 
     point3 orig;
     vec3 dir;
@@ -31,7 +31,7 @@ struct ray {
 
 struct timed_ray {
     ray r;
-    double time;
+    real time;
 };
 
 #endif
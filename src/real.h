@@ -0,0 +1,10 @@
+#pragma once
+
+// Scalar type of the whole render pipeline (vectors, rays, bounds, hit
+// distances, colors). Configure with -DRTWK_SINGLE_PRECISION=ON to render in
+// float, which halves the size of the geometries and the BVH nodes.
+#ifdef RTWK_SINGLE_PRECISION
+using real = float;
+#else
+using real = double;
+#endif
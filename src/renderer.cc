@@ -3,151 +3,162 @@
 #include <texture_impls.h>
 #include <trace_colors.h>
 
+#include <algorithm>
 #include <atomic>
+#include <cmath>
+#include <cstddef>
 #include <cstdint>
 #include <iostream>
 #include <memory>
+#include <numeric>
 #include <print>
 #include <thread>
+#include <utility>
 #include <tracy/Tracy.hpp>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "camera.h"
 #include "hittable_list.h"
+#include "random.h"
+#include "sampler.h"
+#include "scheduler.h"
+#include "stats.h"
 #include "timer.h"
+#include "wavefront.h"
 
 using uint32 = uint32_t;
 
-using deferNoise = std::pair<texture::noise_data, point3>;
+// Attenuation whose value is only computed once the samples of the pixel are
+// traced, so that the textures are evaluated in one tight loop.
+struct attenuation {
+    texture::tag kind;  // solid, noise or image
 
-// TODO: @maybe I could collect images by their pointer?
-using deferImage = std::pair<rtw_shared_image, uvs>;
+    struct noise_data {
+        texture::noise_data noise;
+        point3 p;
+        // Filled in by evaluateNoises.
+        real gray;
+    };
+    // TODO: @maybe I could collect images by their pointer?
+    struct image_data {
+        rtw_shared_image image;
+        uvs uv;
+    };
 
-// Origin is at world origin.
-struct camera {
-    int image_height;     // Rendered image height
-    point3 pixel00_loc;   // Location of pixel 0, 0
-    vec3 pixel_delta_u;   // Offset to pixel to the right
-    vec3 pixel_delta_v;   // Offset to pixel below
-    vec3 u, v, w;         // Camera frame basis vectors
-    vec3 defocus_disk_u;  // Defocus disk horizontal radius
-    vec3 defocus_disk_v;  // Defocus disk vertical radius
-};
+    union data {
+        color solid;
+        noise_data noise;
+        image_data image;
 
-// @cleanup this is no longer a matrix, just arrays
-struct sampleMat {
-    color *solids;
-    deferNoise *noises;
-    deferImage *images;
-
-    static sampleMat request(uint32 spp, uint32 maxDepth) {
-        return {
-            .solids = new color[spp * maxDepth],
-            .noises = new deferNoise[spp * maxDepth],
-            .images = new deferImage[spp * maxDepth],
-        };
-    }
+        constexpr data() {}
+    } as;
 };
 
 struct px_sampleq {
-    struct commitSave {
-        int solids;
-        int noises;
-        int images;
-
-        void accept(commitSave const &other) {
-            solids += other.solids;
-            noises += other.noises;
-            images += other.images;
-        }
+    // Light reaching the camera through a sample: `c` times the attenuations
+    // of the sample before `end`. A path adds one per light it finds, each
+    // sees the attenuations up to where it was found.
+    struct term {
+        color c;
+        int sample;
+        int end;
     };
 
-    sampleMat ptrs;
-    commitSave tally;
-
-    void emplaceSolid(color solid) { ptrs.solids[tally.solids++] = solid; }
+    // The attenuations of the pixel's samples, one after the other.
+    attenuation *atts;
+    int end;
+    // end at the last term, the attenuations after it don't matter.
+    int kept;
+    int sample;
+    term *terms;
+    int termCount = 0;
+
+    void emplaceSolid(color solid) {
+        auto &att = atts[end++];
+        att.kind = texture::tag::solid;
+        att.as.solid = solid;
+    }
 
-    void emplace(texture const *tex, uvs uv, point3 p) {
+    // Returns what russian roulette counts the attenuation as, which is only
+    // exact for solids (see roulette_attenuation).
+    color emplace(texture const *tex, uvs uv, point3 p) {
         tex = traverseChecker(tex, p);
         switch (tex->kind) {
             case texture::tag::solid:
                 emplaceSolid(tex->as.solid);
                 break;
-            case texture::tag::noise:
-                ptrs.noises[tally.noises++] = {tex->as.noise, p};
+            case texture::tag::noise: {
+                auto &att = atts[end++];
+                att.kind = texture::tag::noise;
+                att.as.noise = {tex->as.noise, p, 0};
                 break;
-            case texture::tag::image:
-                ptrs.images[tally.images++] = {tex->as.image, uv};
+            }
+            case texture::tag::image: {
+                auto &att = atts[end++];
+                att.kind = texture::tag::image;
+                att.as.image = {tex->as.image, uv};
                 break;
+            }
             case texture::tag::checker:
                 // Should be unreachable since we did the traverseChecker
                 std::unreachable();
                 break;
         }
+        return roulette_attenuation(tex);
     }
 
-    commitSave commit() { return tally; }
-    void reset() { tally = {}; }
-};
-static vec3 sample_square() {
-    // Returns the vector to a random point in the [-.5,-.5]-[+.5,+.5] unit
-    // square.
-    return vec3(random_double() - 0.5, random_double() - 0.5, 0);
-}
-static point3 random_in_unit_disk() {
-    while (true) {
-        auto p = vec3{random_double(-1., 1.), random_double(-1., 1.), 0};
-        if (p.length_squared() < 1) return p;
+    void addTerm(color c) {
+        terms[termCount++] = {c, sample, end};
+        kept = end;
     }
-}
-static point3 defocus_disk_sample(camera const &cam) {
-    // Returns a random point in the camera defocus disk.
-    auto p = random_in_unit_disk();
-    return (p[0] * cam.defocus_disk_u) + (p[1] * cam.defocus_disk_v);
-}
-
-static timed_ray get_ray(settings const &s, camera const &cam, int i, int j) {
-    // Construct a camera ray originating from the defocus disk and directed
-    // at a randomly sampled point around the pixel location i, j.
-
-    auto offset = sample_square();
-    auto pixel_sample = cam.pixel00_loc +
-                        ((i + offset.x()) * cam.pixel_delta_u) +
-                        ((j + offset.y()) * cam.pixel_delta_v);
-
-    auto ray_origin =
-        (s.defocus_angle <= 0) ? vec3{0, 0, 0} : defocus_disk_sample(cam);
-    auto ray_direction = pixel_sample - ray_origin;
-    auto ray_time = random_double();
-
-    return {ray(ray_origin, ray_direction), ray_time};
-}
 
-// Aligns the normal so that it always points towards the ray origin.
-// Returs whether the face is at the front.
-static bool set_face_normal(vec3 in_dir, vec3 &normal) {
-    auto front_face = dot(in_dir, normal) < 0;
-    normal = front_face ? normal : -normal;
-    return front_face;
-}
+    // The path ends without finding more light.
+    void reset() { end = kept; }
+};
 
-static vec3 random_in_unit_sphere() {
-    while (true) {
-        auto p = random_vec(-1, 1);
-        if (p.length_squared() < 1) return p;
-    }
-}
+using hit_result = std::pair<geometry_ptr, real>;
+
+// Traces the path of camera ray `r`, adding a term to `attenuations` for
+// each light found. `primary`, if present, is the already computed hit of
+// `r`, e.g. from a packet.
+static void geometrySim(settings const &s, timed_ray r,
+                        hittable_list const &world, sampler const &smp,
+                        perlin const &noise, px_sampleq &attenuations,
+                        hit_result const *primary = nullptr) {
+    int depth = s.max_depth;
+    // Density of the last bounce if it was a lambertian one, whose point
+    // sampled the lights as well. 0 otherwise.
+    real bouncePdf = 0;
+    // Throughput of the path for russian roulette. Only the solid
+    // attenuations are known while tracing, the others count as 1.
+    color throughput(1, 1, 1);
+    // Inverse of the probability that russian roulette let the path get
+    // here, which scales every term found from now on.
+    real rouletteWeight = 1;
+    // Whether the path goes on after a bounce.
+    auto survives = [&] {
+        auto q = russian_roulette(s, smp, s.max_depth - depth, throughput);
+        if (q == 0) return false;
+        throughput /= q;
+        rouletteWeight /= q;
+        return true;
+    };
 
-static color geometrySim(color const &background, timed_ray r, int depth,
-                         hittable_list const &world, px_sampleq &attenuations) {
     for (;;) {
+        rng::next_bounce();
         // Too deep and haven't found a light source.
         if (depth <= 0) {
             attenuations.reset();
-            return color(0, 0, 0);
+            return;
         }
         ZoneScopedN("ray frame");
 
         // If the ray hits nothing, return the background color.
-        auto [res, closestHit] = world.hitSelect(r);
+        auto [res, closestHit] =
+            primary ? *std::exchange(primary, nullptr) : world.hitSelect(r);
 
         auto maxT = res ? closestHit : infinity;
 
@@ -159,20 +170,26 @@ static color geometrySim(color const &background, timed_ray r, int depth,
         // just haveh to run both hitSelect and sampleConstantMediums.
 
         // Try sampling a constant medium
-        double cmHit;
+        real cmHit;
         if (auto *cmColor = world.sampleConstantMediums(r, maxT, &cmHit)) {
             // Don't need UVs/normal; we have an isotropic material.
             r.r.orig = r.r.at(cmHit);
             attenuations.emplaceSolid(*cmColor);
+            throughput = throughput * *cmColor;
 
-            r.r.dir = unit_vector(random_in_unit_sphere());
+            r.r.dir = uniform_sphere(smp.get2D());
+            bouncePdf = 0;
             --depth;
+            if (!survives()) {
+                attenuations.reset();
+                return;
+            }
             continue;
         }
 
         if (!res) {
-            attenuations.reset();
-            return background;
+            attenuations.addTerm(s.background * rouletteWeight);
+            return;
         }
 
         auto p = r.r.at(closestHit);
@@ -192,40 +209,36 @@ static color geometrySim(color const &background, timed_ray r, int depth,
         // here we'll have to use the emit value as the 'attenuation' value.
         if (mat.tag == material::kind::diffuse_light) {
             attenuations.emplace(tex, uv, p);
-            return color(1, 1, 1);
+            real weight = rouletteWeight;
+            if (bouncePdf > 0) {
+                weight *= bounce_weight(world, res.relIndex, r.r.orig, p,
+                                        r.time, bouncePdf);
+            }
+            attenuations.addTerm(color(weight, weight, weight));
+            return;
         }
 
-        if (!mat.scatter(r.r.dir, normal, front_face, scattered)) {
+        if (!mat.scatter(r.r.dir, normal, front_face, smp, scattered)) {
             attenuations.reset();
-            return color(0, 0, 0);
+            return;
         }
 
         depth = depth - 1;
-        attenuations.emplace(tex, uv, p);
+        throughput = throughput * attenuations.emplace(tex, uv, p);
+        auto nee = sample_next_event(s, world, mat.tag, p, normal, scattered,
+                                     r.time, smp, noise);
+        if (nee.direct.length_squared() > 0) {
+            attenuations.addTerm(nee.direct * rouletteWeight);
+        }
+        bouncePdf = nee.bouncePdf;
+        if (!survives()) {
+            attenuations.reset();
+            return;
+        }
         r.r = ray(p, scattered);
     }
 }
 
-// NOTE: @misname Not really RLE, just avoiding zeros.
-struct RLE {
-    int location;
-    int count;
-};
-
-struct countArrays {
-    RLE *solids;
-    RLE *noises;
-    RLE *images;
-
-    static countArrays request(uint32 spp) {
-        return {
-            .solids = new RLE[spp],
-            .noises = new RLE[spp],
-            .images = new RLE[spp],
-        };
-    }
-};
-
 // NOTE: @maybe @perf We can't do the transpose of the depth/sample matrix
 // because we have to multiply first. We still could gather multiple rays once
 // we have the scene separated by kind.
@@ -240,160 +253,306 @@ struct countArrays {
 //   if it's in between, any algorithm (saturated or transitory) will behave
 //   mostly the same.
 
+// Running estimate of a pixel, used by adaptive sampling.
+struct pixel_stats {
+    color sum{0, 0, 0};
+    int n = 0;
+    // mean and sum of squared deviations of the luminance. Always in double,
+    // since they accumulate many samples.
+    double mean = 0;
+    double m2 = 0;
+
+    void accept(color const *samples, int count);
+    // Relative standard error of the luminance.
+    double error() const;
+};
+
+// Bump allocator over a single block, which holds every buffer of a worker
+// and is freed with it. Buffers start on their own cache line.
+struct thread_arena {
+    static constexpr size_t cacheLine = 64;
+
+    std::unique_ptr<std::byte[]> block;
+    size_t size = 0;
+    size_t used = 0;
+
+    template <typename T>
+    void reserve(size_t count) {
+        size += cacheLine - 1 + count * sizeof(T);
+    }
+    void allocate() {
+        block = std::make_unique_for_overwrite<std::byte[]>(size);
+    }
+    // Must have been reserved, in the same order.
+    template <typename T>
+    T *take(size_t count) {
+        void *p = block.get() + used;
+        auto space = size - used;
+        auto bytes = count * sizeof(T);
+        if (!std::align(cacheLine, bytes, p, space)) std::unreachable();
+        used = size - space + bytes;
+        return static_cast<T *>(p);
+    }
+};
+
 struct Scanline_Buffers {
-    sampleMat attMat;
-    countArrays counts;
-    double *multiplyBuffer;
+    // Read in this order by the end of samplePixel.
+    px_sampleq::term *terms;
+    attenuation *atts;
     color *samples;
-
-    static Scanline_Buffers request(uint32 spp, uint32 maxDepth) {
-        return {
-            .attMat = sampleMat::request(spp, maxDepth),
-            .counts = countArrays::request(spp),
-            // @cleanup could make these part of the same allocation
-            .multiplyBuffer = new double[spp * maxDepth],
-            .samples = new color[spp],
+    // indexed by image column, only used by adaptive sampling.
+    pixel_stats *stats;
+    int *order;
+
+    // Carves the buffers out of `arena`, which must outlive them.
+    static Scanline_Buffers request(uint32 spp, uint32 maxDepth,
+                                    uint32 imageWidth, thread_arena &arena) {
+        Scanline_Buffers b;
+        auto layout = [&](auto &&place) {
+            // the lights sampled at each bounce and the one at the end.
+            place(b.terms, spp * (maxDepth + 1));
+            place(b.atts, spp * maxDepth);
+            place(b.samples, spp);
+            place(b.stats, imageWidth);
+            place(b.order, imageWidth);
         };
+        layout([&]<typename T>(T *&, size_t count) {
+            arena.reserve<T>(count);
+        });
+        arena.allocate();
+        layout([&]<typename T>(T *&out, size_t count) {
+            out = arena.take<T>(count);
+        });
+        return b;
     }
 };
 
-static void scanLine(settings const &s, camera const &cam,
-                     hittable_list const &world, int const j, color *pixels,
-                     Scanline_Buffers buffers, perlin const &noise) {
-    // NOTE: @maybe a matrix only for the solids and vectors for the  other
-    // types works better. geometrySim could also return whether it is
-    // cancelling/light/background to find what the last (or first) color
-    // multiplier is, and store it in one go. This would allow to do all the
-    // lane multiplies in one loop.
-
-    for (int i = 0; i < s.image_width; i++) {
-        color pixel_color(0, 0, 0);
+// Computes the gray level of every noise attenuation of atts[0, count), in
+// batches of turbulence.
+static void evaluateNoises(attenuation *atts, int count, perlin const &noise) {
+    ZoneScopedN("noises");
+    ZoneColor(tracy::Color::Blue4);
+    static constexpr int chunk = 64;
+    point3 points[chunk];
+    real turbs[chunk];
+    attenuation::noise_data *pending[chunk];
+    int n = 0;
+
+    auto flush = [&] {
+        noise.turb_batch(std::span(points, n), noiseDepth, std::span(turbs, n));
+        for (int k = 0; k < n; ++k) {
+            auto &att = *pending[k];
+            att.gray = noise_from_turb(att.noise, att.p, turbs[k]);
+        }
+        n = 0;
+    };
 
-        int rleSolids = 0;
-        int rleNoises = 0;
-        int rleImages = 0;
+    for (auto &att : std::span(atts, count)) {
+        if (att.kind != texture::tag::noise) continue;
+        points[n] = att.as.noise.p;
+        pending[n++] = &att.as.noise;
+        if (n == chunk) flush();
+    }
+    if (n > 0) flush();
+}
 
-        px_sampleq::commitSave tally{};
+// Traces samples [first, first + count) of pixel (i, j), leaving their final
+// colors in buffers.samples[0, count).
+static void samplePixel(settings const &s, camera const &cam,
+                        hittable_list const &world, int const i, int const j,
+                        int const first, int const count,
+                        Scanline_Buffers buffers, perlin const &noise) {
+    auto const pixel = uint32_t(j * s.image_width + i);
+    auto beginSample = [&](int sample) {
+        rng::begin_sample(s.seed, pixel, uint32_t(first + sample));
+    };
+    auto const smp = make_sampler(s);
+
+    int atts = 0;
+    int terms = 0;
+
+    auto runSample = [&](int sample, timed_ray const &r,
+                         hit_result const *primary) {
+        // NOTE: @trace The first (bottom) lines (black, 399) are pretty bad
+        // (~3.52us)
+        ZoneScopedN("pixel sample");
+        ZoneValue(j);
+        ZoneValue(i);
+
+        px_sampleq q{buffers.atts, atts, atts, sample, buffers.terms + terms};
+
+        geometrySim(s, r, world, smp, noise, q, primary);
+        ZoneTextL("attenuations:");
+        ZoneValue(q.end - atts);
+        // The path ends right after its last term (or is dropped without
+        // any), so the next sample continues the stream from here.
+        atts = q.end;
+        terms += q.termCount;
+
+        buffers.samples[sample] = color(0, 0, 0);
+    };
 
-        for (int sample = 0; sample < s.samples_per_pixel; sample++) {
-            // NOTE: @trace The first (bottom) lines (black, 399) are pretty bad
-            // (~3.52us)
-            ZoneScopedN("pixel sample");
-            ZoneValue(j);
-            ZoneValue(i);
-            auto r = get_ray(s, cam, i, j);
+    if (s.packet_primary) {
+        // The camera rays of a pixel all start around the same spot, so
+        // they go through mostly the same nodes.
+        for (int sample = 0; sample < count;
+             sample += ray_packet::width) {
+            auto lanes =
+                std::min(ray_packet::width, count - sample);
+            timed_ray rays[ray_packet::width];
+            ray_packet packet;
+            for (int lane = 0; lane < lanes; ++lane) {
+                beginSample(sample + lane);
+                rays[lane] = get_ray(s, cam, i, j);
+                packet.set(lane, rays[lane]);
+            }
 
-            auto offset_mat = buffers.attMat;
+            bvh::packet_hits hits;
+            world.hitSelect(packet, hits);
 
-            offset_mat.images += tally.images;
-            offset_mat.noises += tally.noises;
-            offset_mat.solids += tally.solids;
+            for (int lane = 0; lane < lanes; ++lane) {
+                hit_result primary{hits.geoms[lane], hits.t[lane]};
+                // bounces draw the same numbers as without packets.
+                beginSample(sample + lane);
+                runSample(sample + lane, rays[lane], &primary);
+            }
+        }
+    } else {
+        for (int sample = 0; sample < count; sample++) {
+            beginSample(sample);
+            runSample(sample, get_ray(s, cam, i, j), nullptr);
+        }
+    }
 
-            px_sampleq q{offset_mat, px_sampleq::commitSave{}};
+    ZoneScopedNC("attenuation samples", Ctp::Peach);
+    evaluateNoises(buffers.atts, atts, noise);
+
+    // The terms of a sample are in the order they were found, so a single
+    // running product over its attenuations lights all of them, and the
+    // attenuations are read once, in order.
+    int at = 0;
+    int current = -1;
+    color product;
+    for (auto const &t : std::span(buffers.terms, terms)) {
+        if (t.sample != current) {
+            current = t.sample;
+            product = color(1, 1, 1);
+        }
+        for (; at < t.end; ++at) {
+            auto const &att = buffers.atts[at];
+            switch (att.kind) {
+                case texture::tag::solid:
+                    product = product * att.as.solid;
+                    break;
+                case texture::tag::noise:
+                    product = product * att.as.noise.gray;
+                    break;
+                case texture::tag::image:
+                    product = product * sample_image(att.as.image.image,
+                                                     att.as.image.uv);
+                    break;
+                case texture::tag::checker:
+                    std::unreachable();
+            }
+        }
+        buffers.samples[t.sample] += t.c * product;
+    }
+}
 
-            auto bg = geometrySim(s.background, r, s.max_depth, world, q);
-            tally.accept(q.tally);
+static real luminance(color const &c) {
+    return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+}
 
-            // @perf It may be better to log these counts separately so that
-            // I can paint them in a 2D/3D frame.
+void pixel_stats::accept(color const *samples, int count) {
+    for (auto const &c : std::span(samples, count)) {
+        sum += c;
+        // Welford's running variance.
+        auto l = luminance(c);
+        ++n;
+        auto delta = l - mean;
+        mean += delta / n;
+        m2 += delta * (l - mean);
+    }
+}
 
-            auto att_count = q.tally;
-            ZoneTextL("tally:");
-            ZoneValue(att_count.solids);
-            ZoneValue(att_count.noises);
-            ZoneValue(att_count.images);
+double pixel_stats::error() const {
+    if (n < 2) return infinity;
+    auto standardError = std::sqrt(m2 / (n - 1) / n);
+    // relative to the pixel brightness, with a floor so that black pixels
+    // don't need an absurd precision.
+    return standardError / std::max(mean, 1e-2);
+}
 
-            if (att_count.solids) {
-                buffers.counts.solids[rleSolids++] = {sample, att_count.solids};
-            }
-            if (att_count.noises) {
-                buffers.counts.noises[rleNoises++] = {sample, att_count.noises};
-            }
-            if (att_count.images) {
-                buffers.counts.images[rleImages++] = {sample, att_count.images};
-            }
+// Adaptive version of the scanLine loop. Each pixel gets at least
+// `adaptive_min_samples` and stops as soon as its error estimate falls under
+// `adaptive_threshold` (or it reaches `samples_per_pixel`). The samples that
+// were saved are then spent on the noisiest pixels of the row, up to
+// `adaptive_max_factor` times the regular budget per pixel.
+static void adaptiveScanLine(settings const &s, camera const &cam,
+                             hittable_list const &world, int const j,
+                             int const x0, int const x1, color *pixels,
+                             Scanline_Buffers buffers, perlin const &noise) {
+    ZoneScopedN("adaptive scanline");
+    auto const batch =
+        std::min(s.samples_per_pixel, std::max(1, s.adaptive_min_samples));
+    auto converged = [&](pixel_stats const &st) {
+        return st.error() <= s.adaptive_threshold;
+    };
+    auto sampleBatch = [&](int i, int n) {
+        samplePixel(s, cam, world, i, j, buffers.stats[i].n, n, buffers,
+                    noise);
+        buffers.stats[i].accept(buffers.samples, n);
+    };
 
-            buffers.samples[sample] = bg;
+    long budget = 0;
+    for (int i = x0; i < x1; ++i) {
+        auto &st = buffers.stats[i];
+        st = {};
+        while (st.n < s.samples_per_pixel &&
+               !(st.n >= batch && converged(st))) {
+            sampleBatch(i, std::min(batch, s.samples_per_pixel - st.n));
         }
+        budget += s.samples_per_pixel - st.n;
+    }
 
-        // NOTE: @maybe consider filling the color matrix with 1s where samples
-        // shouldn't be recorded. That way loops could be fixed at least.
-
-        {
-            ZoneScopedNC("attenuation samples", Ctp::Peach);
-            {
-                ZoneScopedN("noises");
-                ZoneColor(tracy::Color::Blue4);
-
-                {
-                    // @perf I can further simplify this because
-                    // `sample_noise`'s components are all the same, so I could
-                    // just fill an array of doubles.
-                    ZoneScopedN("sample");
-                    for (int i = 0; i < tally.noises; ++i) {
-                        auto const &[noiseData, p] = buffers.attMat.noises[i];
-                        buffers.multiplyBuffer[i] =
-                            sample_noise(noiseData, p, noise);
-                    }
-                }
-
-                // @cutnpaste with images, solids.
-                {
-                    ZoneScopedN("mul");
-                    int start = 0;
-                    for (int rleI = 0; rleI < rleNoises; ++rleI) {
-                        auto [sample, count] = buffers.counts.noises[rleI];
-                        color res = buffers.samples[sample];
-                        for (auto grayscale :
-                             std::span(buffers.multiplyBuffer + start, count)) {
-                            res = res * grayscale;
-                        }
-                        start += count;
-                        buffers.samples[sample] = res;
-                    }
-                }
-            }
-
-            {
-                ZoneScopedN("images");
-                ZoneColor(tracy::Color::Lavender);
-
-                //  @perf This is pretty slow. The loop takes most
-                //  of the credit, where Tracy shows two big stalls on loop
-                //  entry & exit. Self time is ~50%
-                int start = 0;
-                for (int rleI = 0; rleI < rleImages; ++rleI) {
-                    auto [sample, count] = buffers.counts.images[rleI];
-                    color res = buffers.samples[sample];
-                    for (auto const &[image, uv] :
-                         std::span(buffers.attMat.images + start, count)) {
-                        res = res * sample_image(image, uv);
-                    }
-                    start += count;
-                    buffers.samples[sample] = res;
-                }
-            }
+    // Redistribute, noisiest pixels first.
+    auto const cap = s.samples_per_pixel * std::max(1, s.adaptive_max_factor);
+    auto order = std::span(buffers.order, x1 - x0);
+    std::iota(order.begin(), order.end(), x0);
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+        return buffers.stats[a].error() > buffers.stats[b].error();
+    });
+    for (auto i : order) {
+        auto &st = buffers.stats[i];
+        while (budget > 0 && st.n < cap && !converged(st)) {
+            auto n = int(std::min<long>({batch, budget, cap - st.n}));
+            sampleBatch(i, n);
+            budget -= n;
+        }
+        if (budget <= 0) break;
+    }
 
-            {
-                ZoneScopedN("solids");
-                ZoneColor(Ctp::Pink);
+    for (int i = x0; i < x1; ++i) {
+        auto const &st = buffers.stats[i];
+        pixels[j * s.image_width + i] = st.sum / st.n;
+    }
+}
 
-                // @cutnpaste with noises, images.
-                int start = 0;
-                for (int rleI = 0; rleI < rleSolids; ++rleI) {
-                    auto [sample, count] = buffers.counts.solids[rleI];
-                    color res = buffers.samples[sample];
+// Renders pixels [x0, x1) of row j.
+static void scanLine(settings const &s, camera const &cam,
+                     hittable_list const &world, int const j, int const x0,
+                     int const x1, color *pixels, Scanline_Buffers buffers,
+                     perlin const &noise) {
+    if (s.adaptive) {
+        adaptiveScanLine(s, cam, world, j, x0, x1, pixels, buffers, noise);
+        return;
+    }
 
-                    for (auto const &col :
-                         std::span(buffers.attMat.solids + start, count)) {
-                        res = res * col;
-                    }
+    for (int i = x0; i < x1; i++) {
+        color pixel_color(0, 0, 0);
 
-                    start += count;
-                    buffers.samples[sample] = res;
-                }
-            }
-        }
+        samplePixel(s, cam, world, i, j, 0, s.samples_per_pixel, buffers,
+                    noise);
 
         for (int sample = 0; sample < s.samples_per_pixel; ++sample) {
             pixel_color += buffers.samples[sample];
@@ -404,77 +563,56 @@ static void scanLine(settings const &s, camera const &cam,
 }
 
 static void renderThread(settings const &s, camera const &cam,
-                         std::atomic<int> &__restrict__ tileid,
-                         std::atomic<int> &__restrict__ remain_scanlines,
-                         size_t const stop_at, hittable_list const &world,
-                         color *pixels) noexcept {
+                         tile_scheduler &tiles, int const worker,
+                         std::atomic<int> &__restrict__ remain_tiles,
+                         hittable_list const &world, color *pixels) noexcept {
     // NOTE: @waste @mem Could reuse a solids lane (maybe the last/first one)
     // for the final lane.
 
-    auto buffers = Scanline_Buffers::request(s.samples_per_pixel, s.max_depth);
+    // Both are freed when the worker is done.
+    Scanline_Buffers buffers{};
+    thread_arena arena;
+    wavefront_buffers wavefront;
+    if (s.wavefront) {
+        wavefront = wavefront_buffers::request(
+            wavefront_buffers::default_paths, s.tile_size);
+    } else {
+        buffers = Scanline_Buffers::request(s.samples_per_pixel, s.max_depth,
+                                            s.image_width, arena);
+    }
 
+    // every worker must build the same noise.
+    seed_random(0);
     auto noise = std::make_unique<perlin>();
 
-    for (;;) {
-        auto j = tileid.fetch_add(1, std::memory_order_acq_rel);
-
-        if (j >= s.image_width) return;
-
+    tile t;
+    while (tiles.next(worker, t)) {
         // TODO: render worker state struct
-        scanLine(s, cam, world, j, pixels, buffers, *noise.get());
+        if (s.wavefront) {
+            wavefrontTile(s, cam, world, t, pixels, wavefront, *noise.get());
+        } else {
+            for (int j = t.y0; j < t.y1; ++j) {
+                scanLine(s, cam, world, j, t.x0, t.x1, pixels, buffers,
+                         *noise.get());
+            }
+        }
 
-        remain_scanlines.fetch_sub(1, std::memory_order_acq_rel);
-        remain_scanlines.notify_one();
+        remain_tiles.fetch_sub(1, std::memory_order_acq_rel);
+        remain_tiles.notify_one();
     }
 }
 
-static camera make_camera(settings const &s) {
-    camera cam;
-    cam.image_height = int(s.image_width / s.aspect_ratio);
-    cam.image_height = (cam.image_height < 1) ? 1 : cam.image_height;
-
-    // Determine viewport dimensions.
-    auto theta = degrees_to_radians(s.vfov);
-    auto h = tan(theta / 2);
-    auto viewport_height = 2 * h * s.focus_dist;
-    auto viewport_width =
-        viewport_height * (double(s.image_width) / cam.image_height);
-
-    // Calculate the u,v,w unit basis vectors for the camera coordinate
-    // frame.
-    cam.w = unit_vector(-s.lookat);
-    cam.u = unit_vector(cross(s.vup, cam.w));
-    cam.v = cross(cam.w, cam.u);
-
-    // Calculate the vectors across the horizontal and down the vertical
-    // viewport edges.
-    vec3 viewport_u =
-        viewport_width * cam.u;  // Vector across viewport horizontal edge
-    vec3 viewport_v =
-        viewport_height * -cam.v;  // Vector down viewport vertical edge
-
-    // Calculate the horizontal and vertical delta vectors from pixel to
-    // pixel.
-    cam.pixel_delta_u = viewport_u / s.image_width;
-    cam.pixel_delta_v = viewport_v / cam.image_height;
-
-    // Calculate the location of the upper left pixel.
-    auto viewport_upper_left =
-        -(s.focus_dist * cam.w) - viewport_u / 2 - viewport_v / 2;
-    cam.pixel00_loc =
-        viewport_upper_left + 0.5 * (cam.pixel_delta_u + cam.pixel_delta_v);
-
-    // Calculate the camera defocus disk basis vectors.
-    auto defocus_radius =
-        s.focus_dist * tan(degrees_to_radians(s.defocus_angle / 2));
-    cam.defocus_disk_u = cam.u * defocus_radius;
-    cam.defocus_disk_v = cam.v * defocus_radius;
-    return cam;
-}
-
-void render(hittable_list world, settings s) {
-    // offset everything so that what was at s.lookfrom is at 0, 0, 0.
-    world.transformAll(transform(0, -s.lookfrom));
+render_timings render(hittable_list world, settings s) {
+    render_timings timings;
+    rtwk::stopwatch stage_timer;
+    stage_timer.start();
+    // offset everything so that what was at s.lookfrom is at 0, 0, 0. Scene
+    // files are stored that way already, and can't be moved.
+    if (s.lookfrom.length_squared() != 0) {
+        world.transformAll(transform(0, -s.lookfrom));
+    }
+    world.prepare(s);
+    timings.prepare = stage_timer.stop();
     // I can't rotate the world because how noise is generated (the sin pattern)
     // depends on absolute world position and not the position relative to the camera.
     s.lookat = s.lookat - s.lookfrom;
@@ -482,43 +620,56 @@ void render(hittable_list world, settings s) {
     auto pixels = std::make_unique<color[]>(size_t(s.image_width) *
                                             size_t(cam.image_height));
 
-    int start = cam.image_height;
+#ifdef _OPENMP
+    auto workers = omp_get_max_threads();
+#else
+    // TODO: if I keep adding atomic things, then single threaded
+    // performance will be lost.
+    auto workers = 1;
+#endif
+
+    tile_scheduler tiles(s.image_width, cam.image_height, s.tile_size,
+                         workers);
+
+    int start = tiles.tileCount();
     static constexpr int stop_at = 0;
-    std::atomic<int> remain_scanlines alignas(64){start};
+    std::atomic<int> remain_tiles alignas(64){start};
 
-    auto progress_thread = std::thread([limit = start, &remain_scanlines]() {
+    auto progress_thread = std::thread([limit = start, &remain_tiles]() {
         auto last_remain = limit + 1;
         while (true) {
-            remain_scanlines.wait(last_remain, std::memory_order_acquire);
+            remain_tiles.wait(last_remain, std::memory_order_acquire);
 
-            auto remain = remain_scanlines.load(std::memory_order_acquire);
+            auto remain = remain_tiles.load(std::memory_order_acquire);
             last_remain = remain;
-            std::clog << "\r\x1b[2K\x1b[?25lScanlines remaining: " << remain
+            std::clog << "\r\x1b[2K\x1b[?25lTiles remaining: " << remain
                       << "\x1b[?25h" << std::flush;
             if (remain == stop_at) break;
         }
         std::clog << "\r\x1b[2K" << std::flush;
     });
 
-#ifdef _OPENMP
-#else
-    // TODO: if I keep adding atomic things, then single threaded
-    // performance will be lost.
-#endif
-
     rtwk::stopwatch render_timer;
     render_timer.start();
-    std::atomic<int> tileid alignas(64);
     // worker loop
 #pragma omp parallel
     {
-        ::renderThread(s, cam, tileid, remain_scanlines, stop_at, world,
+#ifdef _OPENMP
+        auto worker = omp_get_thread_num();
+#else
+        auto worker = 0;
+#endif
+        ::renderThread(s, cam, tiles, worker, remain_tiles, world,
                        pixels.get());
+        stats::flush();
     }
     auto render_time = render_timer.stop();
     rtwk::print_duration(std::cout, "Render", render_time);
+    timings.render = render_time;
     progress_thread.join();
 
+    stage_timer.start();
+
     std::clog << "\r\x1b[2KWriting image...\n";
 
     // 1. Encode the image into RGB
@@ -545,6 +696,8 @@ void render(hittable_list world, settings s) {
 
     stbi_write_png("test.png", s.image_width, cam.image_height, 3, &bytes[0],
                    0);
+    timings.write = stage_timer.stop();
 
     std::clog << "Done.\n";
+    return timings;
 }
@@ -1,6 +1,24 @@
 #pragma once
 
+#include <chrono>
+
 #include "settings.h"
 #include "hittable_list.h"
 
-void render(hittable_list world, settings s);
+// Wall time of each stage of a render.
+struct render_timings {
+    std::chrono::nanoseconds prepare;  // moving the world and its trees
+    std::chrono::nanoseconds render;
+    std::chrono::nanoseconds write;  // encoding and writing the image
+};
+
+// Aligns the normal so that it always points towards the ray origin.
+// Returns whether the face is at the front. Shared by both pipelines.
+inline bool set_face_normal(vec3 in_dir, vec3 &normal) {
+    auto front_face = dot(in_dir, normal) < 0;
+    normal = front_face ? normal : -normal;
+    return front_face;
+}
+
+// Renders to test.png.
+render_timings render(hittable_list world, settings s);
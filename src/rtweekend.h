@@ -15,6 +15,7 @@
 #include <memory>
 
 #include "random.h"
+#include "real.h"
 
 // C++ Std Usings
 
@@ -25,16 +26,20 @@ using std::sqrt;
 
 // Constants
 
-static constexpr double infinity = 1e11;
-static constexpr double pi = 3.1415926535897932385;
+static constexpr real infinity = 1e11;
+static constexpr real pi = 3.1415926535897932385;
+// How far a hit point may be from the surface it's on (e.g. to tell which face
+// of a box was hit). Floats need a lot more slack.
+static constexpr real surface_epsilon =
+    sizeof(real) == sizeof(float) ? 1e-3 : 1e-8;
 
 // Utility Functions
 
-inline double degrees_to_radians(double degrees) {
+inline real degrees_to_radians(real degrees) {
     return degrees * pi / 180.0;
 }
 
-inline double random_double(double min, double max) {
+inline real random_double(real min, real max) {
     // Returns a random real in [min,max).
     return min + (max - min) * random_double();
 }
@@ -49,7 +54,7 @@ struct range {
 };
 
 struct uvs {
-    double u, v;
+    real u, v;
 };
 
 #endif
@@ -0,0 +1,282 @@
+#include "sampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+
+#include "random.h"
+#include "rtweekend.h"
+
+// Largest real under 1, stratified results may round up to 1 otherwise.
+static constexpr real oneMinusEpsilon =
+    1 - std::numeric_limits<real>::epsilon() / 2;
+
+// Finalizer of MurmurHash3.
+static uint32_t mix(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+static uint32_t combine(uint32_t seed, uint32_t v) {
+    return mix(seed ^ (v + 0x9e3779b9 + (seed << 6) + (seed >> 2)));
+}
+
+// Seed of dimension `dim` of the current bounce, the same for every pixel.
+static uint32_t dimensionSeed(rng::stream const &st, uint32_t dim) {
+    auto h = combine(mix(uint32_t(st.key)), uint32_t(st.key >> 32));
+    return combine(combine(h, st.c.bounce), dim);
+}
+
+// Same, but different for every pixel.
+static uint32_t pixelSeed(rng::stream const &st, uint32_t dim) {
+    return combine(dimensionSeed(st, dim), st.c.pixel);
+}
+
+static uint32_t reverseBits(uint32_t x) {
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ff) << 8) | ((x & 0xff00ff00) >> 8);
+    x = ((x & 0x0f0f0f0f) << 4) | ((x & 0xf0f0f0f0) >> 4);
+    x = ((x & 0x33333333) << 2) | ((x & 0xcccccccc) >> 2);
+    x = ((x & 0x55555555) << 1) | ((x & 0xaaaaaaaa) >> 1);
+    return x;
+}
+
+// Permutation of [0, n) picked by `p`, from Kensler's "Correlated
+// Multi-Jittered Sampling".
+static uint32_t permute(uint32_t i, uint32_t n, uint32_t p) {
+    auto w = n - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+    do {
+        i ^= p;
+        i *= 0xe170893d;
+        i ^= p >> 16;
+        i ^= (i & w) >> 4;
+        i ^= p >> 8;
+        i *= 0x0929eb3f;
+        i ^= p >> 23;
+        i ^= (i & w) >> 1;
+        i *= 1 | p >> 27;
+        i *= 0x6935fa69;
+        i ^= (i & w) >> 11;
+        i *= 0x74dcb303;
+        i ^= (i & w) >> 2;
+        i *= 0x9e501cc3;
+        i ^= (i & w) >> 2;
+        i *= 0xc860a3df;
+        i &= w;
+        i ^= i >> 5;
+    } while (i >= n);
+    return (i + p) % n;
+}
+
+// Owen scrambling by hashing, from Burley's "Practical Hash-based Owen
+// Scrambling": every bit is flipped depending on the bits above it.
+static uint32_t nestedScramble(uint32_t x, uint32_t seed) {
+    x = reverseBits(x);
+    x ^= x * 0x3d20adea;
+    x += seed;
+    x *= (seed >> 16) | 1;
+    x ^= x * 0x05526c56;
+    x ^= x * 0x53a22864;
+    return reverseBits(x);
+}
+
+// Second dimension of the Sobol sequence, the first one is reverseBits.
+static uint32_t sobol1(uint32_t index) {
+    uint32_t x = 0;
+    for (uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1) {
+        if (index & 1) x ^= v;
+    }
+    return x;
+}
+
+// Roberts' R2 sequence, from the plastic number.
+static constexpr double r2Alpha1 = 0.75487766624669276005;
+static constexpr double r2Alpha2 = 0.56984029099805326591;
+static constexpr double goldenAlpha = 0.61803398874989484820;
+
+static double fract(double x) { return x - std::floor(x); }
+
+// Index of `sample` in the lattice of rank1. A lattice is the same point
+// set for every dimension, so the first samples_per_pixel are shuffled per
+// pixel and dimension, otherwise the dimensions would move in lockstep.
+static uint32_t latticeIndex(sampler const &smp, rng::stream const &st,
+                             uint32_t dim) {
+    auto const n = uint32_t(smp.samples_per_pixel);
+    auto const sample = st.c.sample;
+    return sample < n ? permute(sample, n, pixelSeed(st, dim)) : sample;
+}
+
+// Shift of pixel `pixel` for rank1, an R2 dither: neighbouring pixels get
+// well spread shifts, so their errors don't clump like with white noise.
+static sample2 pixelShift(uint32_t pixel, int image_width) {
+    auto i = double(pixel % uint32_t(image_width));
+    auto j = double(pixel / uint32_t(image_width));
+    return {real(fract(i * r2Alpha1 + j * r2Alpha2)),
+            real(fract(i * r2Alpha2 + j * r2Alpha1))};
+}
+
+real sampler::get1D() const {
+    auto const &st = rng::current();
+    auto const sample = st.c.sample;
+    auto const dim = st.c.dimension;
+
+    // Every kind moves the stream on by one dimension, but only those that
+    // jitter draw a number for it.
+    switch (kind) {
+        case sampler_kind::independent:
+            return random_double();
+        case sampler_kind::stratified: {
+            auto const u = random_double();
+            auto const n = uint32_t(samples_per_pixel);
+            // past the budget, e.g. with adaptive sampling.
+            if (sample >= n) return u;
+            auto stratum = permute(sample, n, pixelSeed(st, dim));
+            return std::min((stratum + u) / n, oneMinusEpsilon);
+        }
+        case sampler_kind::sobol: {
+            rng::skip(1);
+            auto seed = pixelSeed(st, dim);
+            auto index = nestedScramble(sample, seed);
+            return rng::to_unit(nestedScramble(reverseBits(index), mix(seed)));
+        }
+        case sampler_kind::rank1: {
+            rng::skip(1);
+            auto shift = pixelShift(st.c.pixel, image_width);
+            auto offset = rng::to_unit(dimensionSeed(st, dim));
+            auto k = latticeIndex(*this, st, dim);
+            return std::min(real(fract(offset + shift.x + k * goldenAlpha)),
+                            oneMinusEpsilon);
+        }
+    }
+    std::unreachable();
+}
+
+sample2 sampler::get2D() const {
+    auto const &st = rng::current();
+    auto const sample = st.c.sample;
+    auto const dim = st.c.dimension;
+
+    // See get1D, with two dimensions.
+    switch (kind) {
+        case sampler_kind::independent: {
+            auto const ux = random_double();
+            return {ux, random_double()};
+        }
+        case sampler_kind::stratified: {
+            auto const ux = random_double();
+            auto const uy = random_double();
+            auto const n = uint32_t(samples_per_pixel);
+            if (sample >= n) return {ux, uy};
+            auto m = uint32_t(std::sqrt(double(n)));
+            if (m * m < n) ++m;
+            auto const rows = (n + m - 1) / m;
+            auto const seed = pixelSeed(st, dim);
+            // A grid that isn't full would leave its last row and columns
+            // short of samples, so then each axis is stratified on its own
+            // (with the n strata of get1D, shuffled independently).
+            if (m * rows != n) {
+                auto sx = permute(sample, n, seed * 0x51633e2d);
+                auto sy = permute(sample, n, seed * 0x68bc21eb);
+                return {std::min((sx + ux) / n, oneMinusEpsilon),
+                        std::min((sy + uy) / n, oneMinusEpsilon)};
+            }
+            // m x rows grid, every sample in its own row and column as
+            // well (Kensler's correlated multi-jittered sampling).
+            auto s = permute(sample, n, seed * 0x51633e2d);
+            auto sx = permute(s % m, m, seed * 0x68bc21eb);
+            auto sy = permute(s / m, rows, seed * 0x02e5be93);
+            auto x = (s % m + (sy + ux) / rows) / m;
+            auto y = (s / m + (sx + uy) / m) / rows;
+            return {std::min(x, oneMinusEpsilon), std::min(y, oneMinusEpsilon)};
+        }
+        case sampler_kind::sobol: {
+            // The index is shuffled per pixel and pair of dimensions, so
+            // pairs don't correlate with each other.
+            rng::skip(2);
+            auto seed = pixelSeed(st, dim);
+            auto index = nestedScramble(sample, seed);
+            auto x = nestedScramble(reverseBits(index), mix(seed ^ 1));
+            auto y = nestedScramble(sobol1(index), mix(seed ^ 2));
+            return {rng::to_unit(x), rng::to_unit(y)};
+        }
+        case sampler_kind::rank1: {
+            rng::skip(2);
+            auto shift = pixelShift(st.c.pixel, image_width);
+            auto seed = dimensionSeed(st, dim);
+            auto k = latticeIndex(*this, st, dim);
+            auto x = fract(rng::to_unit(seed) + shift.x + k * r2Alpha1);
+            auto y = fract(rng::to_unit(mix(seed)) + shift.y + k * r2Alpha2);
+            return {std::min(real(x), oneMinusEpsilon),
+                    std::min(real(y), oneMinusEpsilon)};
+        }
+    }
+    std::unreachable();
+}
+
+sampler make_sampler(settings const &s) {
+    return {s.sampler, s.samples_per_pixel, s.image_width};
+}
+
+// Smallest survival probability, so that the paths that go on aren't scaled
+// up without bound.
+static constexpr real rouletteFloor = 0.05;
+
+real russian_roulette(settings const &s, sampler const &smp, int bounces,
+                      color const &throughput) {
+    if (s.roulette_depth < 0 || bounces < s.roulette_depth) return 1;
+    auto beta = std::max({throughput.x(), throughput.y(), throughput.z()});
+    if (beta >= 1) return 1;
+    auto q = std::max(beta, rouletteFloor);
+    return smp.get1D() < q ? q : 0;
+}
+
+vec3 concentric_disk(sample2 u) {
+    auto x = 2 * u.x - 1;
+    auto y = 2 * u.y - 1;
+    if (x == 0 && y == 0) return vec3(0, 0, 0);
+
+    real r, theta;
+    if (std::abs(x) > std::abs(y)) {
+        r = x;
+        theta = (pi / 4) * (y / x);
+    } else {
+        r = y;
+        theta = pi / 2 - (pi / 4) * (x / y);
+    }
+    return vec3(r * std::cos(theta), r * std::sin(theta), 0);
+}
+
+vec3 uniform_sphere(sample2 u) {
+    auto z = 1 - 2 * u.x;
+    auto r = std::sqrt(std::max(real(0), 1 - z * z));
+    auto phi = 2 * pi * u.y;
+    return vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+vec3 cosine_hemisphere(vec3 const &n, sample2 u) {
+    auto d = concentric_disk(u);
+    auto z = std::sqrt(std::max(real(0), 1 - d.length_squared()));
+    vec3 t, b;
+    orthonormal_basis(n, t, b);
+    return d.x() * t + d.y() * b + z * n;
+}
+
+void orthonormal_basis(vec3 const &n, vec3 &t, vec3 &b) {
+    // From Duff et al. "Building an Orthonormal Basis, Revisited".
+    auto sign = std::copysign(real(1), n.z());
+    auto a = -1 / (sign + n.z());
+    auto c = n.x() * n.y() * a;
+    t = vec3(1 + sign * n.x() * n.x() * a, sign * c, -sign * n.x());
+    b = vec3(c, sign + n.y() * n.y() * a, -n.y());
+}
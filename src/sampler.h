@@ -0,0 +1,46 @@
+#pragma once
+
+#include "settings.h"
+#include "vec3.h"
+
+struct sample2 {
+    real x, y;
+};
+
+// Per-dimension samples of the calling thread's rng::stream (see random.h).
+// Each get1D() / get2D() takes the next one / two dimensions of the current
+// bounce; the kind decides how the numbers of a dimension are spread over the
+// samples of a pixel. Independent numbers are random_double(); the others are
+// stratified over rng::counter::sample and decorrelated between pixels and
+// dimensions by hashing, so they converge faster for the same sample count.
+struct sampler {
+    sampler_kind kind = sampler_kind::independent;
+    int samples_per_pixel = 1;  // number of strata of stratified
+    int image_width = 1;        // to find the pixel of rank1
+
+    real get1D() const;
+    sample2 get2D() const;
+};
+
+sampler make_sampler(settings const &s);
+
+// Russian roulette for a path with `throughput` (an upper bound is enough)
+// after `bounces` bounces, see settings::roulette_depth. Returns the
+// probability that the path goes on, by which its throughput must then be
+// divided, or 0 if it stops here. Draws a dimension only when it may stop.
+real russian_roulette(settings const &s, sampler const &smp, int bounces,
+                      color const &throughput);
+
+// Direct mappings of a sample in [0, 1)^2, without rejection loops.
+
+// Shirley and Chiu's concentric mapping onto the unit disk (z = 0).
+vec3 concentric_disk(sample2 u);
+// Uniform direction.
+vec3 uniform_sphere(sample2 u);
+// Direction around unit vector `n` with a density proportional to the cosine
+// (Malley's method).
+vec3 cosine_hemisphere(vec3 const &n, sample2 u);
+
+// Unit vectors `t` and `b` that make an orthonormal basis with the unit
+// vector `n`.
+void orthonormal_basis(vec3 const &n, vec3 &t, vec3 &b);
@@ -0,0 +1,337 @@
+#include "scene_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <print>
+#include <span>
+#include <tracy/Tracy.hpp>
+#include <unordered_map>
+
+#include "constant_medium.h"
+#include "geometry.h"
+#include "hittable.h"
+#include "material.h"
+#include "transforms.h"
+
+static constexpr char fileMagic[8] = {'R', 'T', 'W', 'K', 'S', 'C', 'N', 0};
+// Bump on any change to the layout of the file or of the stored structs.
+static constexpr uint32_t fileVersion = 5;
+// Every section starts at a multiple of this, the boxes need 32.
+static constexpr size_t sectionAlign = 64;
+// Same as rtw_stb_image.cc.
+static constexpr int floatsPerPixel = 3;
+
+namespace {
+enum section : int {
+    node_ends,
+    boxes,
+    nodes,
+    geoms,
+    select_geoms,
+    objects,
+    textures,
+    pixels,
+    media,
+    media_albedos,
+    section_count,
+};
+
+struct section_entry {
+    uint64_t offset;  // in bytes, from the start of the file.
+    uint64_t count;   // in elements.
+};
+
+// lightInfo without the texture pointer.
+struct stored_object {
+    material::kind tag;
+    real param;  // fuzz or refraction index
+    int32_t texture;  // index in the textures section, or -1
+};
+
+// texture without pointers.
+struct stored_texture {
+    texture::tag kind;
+    int32_t even, odd;      // checker, indices in the textures section
+    int32_t width, height;  // image
+    real scale;             // checker and noise
+    color solid;
+    uint64_t pixels;  // image, index of its first float in the pixels section
+};
+
+struct file_header {
+    char magic[8];
+    uint32_t version;
+    // Catch files written with the other precision or another geometry
+    // layout.
+    uint32_t realSize;
+    uint32_t geometrySize;
+    uint32_t textureSize;
+    // `s` is stored as is, so a new setting moves the ones after it.
+    uint32_t settingsSize;
+    settings s;
+    section_entry sections[section_count];
+};
+}  // namespace
+
+static constexpr size_t sectionElemSize[section_count] = {
+    sizeof(int),
+    sizeof(aabb),
+    sizeof(bvh::bvh_node),
+    sizeof(geometry),
+    sizeof(geometry),
+    sizeof(stored_object),
+    sizeof(stored_texture),
+    sizeof(float),
+    sizeof(constant_medium),
+    sizeof(color),
+};
+
+scene_file::~scene_file() {
+    if (base) munmap(const_cast<void *>(base), size);
+}
+
+namespace {
+// Flattens the texture graph into an array, checkers refer to their
+// children by index.
+struct texture_table {
+    std::vector<stored_texture> textures;
+    std::vector<float> pixels;
+    std::unordered_map<texture const *, int32_t> indices;
+
+    int32_t add(texture const *tex) {
+        if (!tex) return -1;
+        if (auto it = indices.find(tex); it != indices.end()) {
+            return it->second;
+        }
+
+        stored_texture st{};
+        st.kind = tex->kind;
+        switch (tex->kind) {
+            case texture::tag::solid:
+                st.solid = tex->as.solid;
+                break;
+            case texture::tag::noise:
+                st.scale = tex->as.noise.scale;
+                break;
+            case texture::tag::checker:
+                st.scale = tex->as.checker.inv_scale;
+                st.even = add(tex->as.checker.even);
+                st.odd = add(tex->as.checker.odd);
+                break;
+            case texture::tag::image: {
+                auto const &img = tex->as.image;
+                st.pixels = pixels.size();
+                // a failed load is stored as such, and shows as magenta.
+                if (img.fdata) {
+                    st.width = img.image_width;
+                    st.height = img.image_height;
+                    pixels.insert(pixels.end(), img.fdata,
+                                  img.fdata + size_t(st.width) * st.height *
+                                                  floatsPerPixel);
+                }
+                break;
+            }
+        }
+
+        auto index = int32_t(textures.size());
+        textures.push_back(st);
+        indices.emplace(tex, index);
+        return index;
+    }
+};
+}  // namespace
+
+bool scene_file::write(char const *path, hittable_list world, settings s) {
+    ZoneScopedN("scene file write");
+    if (!world.meshes.empty() || !world.blases.empty()) {
+        std::println(stderr,
+                     "ERROR: Scene files can't store meshes or instances.");
+        return false;
+    }
+
+    // NOTE: @cutnpaste from render.
+    if (s.lookfrom.length_squared() != 0) {
+        world.transformAll(transform(0, -s.lookfrom));
+    }
+    world.prepare(s);
+    s.lookat = s.lookat - s.lookfrom;
+    s.lookfrom = point3(0, 0, 0);
+
+    texture_table table;
+    std::vector<stored_object> objects;
+    objects.reserve(world.objects.size());
+    for (auto const &obj : world.objects) {
+        objects.push_back(
+            {obj.mat.tag, obj.mat.data.fuzz, table.add(obj.tex)});
+    }
+
+    auto tree = world.treeView();
+    std::span<std::byte const> data[section_count] = {
+        std::as_bytes(tree.node_ends),
+        std::as_bytes(tree.boxes),
+        std::as_bytes(tree.nodes),
+        std::as_bytes(tree.geoms),
+        std::as_bytes(std::span{world.selectGeoms}),
+        std::as_bytes(std::span{objects}),
+        std::as_bytes(std::span{table.textures}),
+        std::as_bytes(std::span{table.pixels}),
+        std::as_bytes(std::span{world.cms}),
+        std::as_bytes(std::span{world.cmAlbedos}),
+    };
+
+    file_header h{};
+    std::memcpy(h.magic, fileMagic, sizeof(fileMagic));
+    h.version = fileVersion;
+    h.realSize = sizeof(real);
+    h.geometrySize = sizeof(geometry);
+    h.textureSize = sizeof(stored_texture);
+    h.settingsSize = sizeof(settings);
+    h.s = s;
+    uint64_t offset = sizeof(file_header);
+    for (int i = 0; i < section_count; ++i) {
+        offset = (offset + sectionAlign - 1) / sectionAlign * sectionAlign;
+        h.sections[i] = {offset, data[i].size() / sectionElemSize[i]};
+        offset += data[i].size();
+    }
+
+    auto *f = std::fopen(path, "wb");
+    if (!f) {
+        std::println(stderr, "ERROR: Could not create scene file '{}'.",
+                     path);
+        return false;
+    }
+    bool ok = std::fwrite(&h, sizeof(h), 1, f) == 1;
+    static constexpr std::byte zeros[sectionAlign] = {};
+    uint64_t written = sizeof(h);
+    for (int i = 0; i < section_count && ok; ++i) {
+        auto padding = h.sections[i].offset - written;
+        ok = std::fwrite(zeros, 1, padding, f) == padding &&
+             std::fwrite(data[i].data(), 1, data[i].size(), f) ==
+                 data[i].size();
+        written = h.sections[i].offset + data[i].size();
+    }
+    ok = std::fclose(f) == 0 && ok;
+    if (!ok) {
+        std::println(stderr, "ERROR: Could not write scene file '{}'.", path);
+    }
+    return ok;
+}
+
+template <typename T>
+static std::span<T const> sectionSpan(void const *base, file_header const &h,
+                                      section sec) {
+    auto const &entry = h.sections[sec];
+    return {reinterpret_cast<T const *>(static_cast<std::byte const *>(base) +
+                                        entry.offset),
+            size_t(entry.count)};
+}
+
+bool scene_file::load(char const *path, hittable_list &world, settings &s) {
+    ZoneScopedN("scene file load");
+    auto fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        std::println(stderr, "ERROR: Could not open scene file '{}'.", path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(file_header)) {
+        std::println(stderr, "ERROR: '{}' is not a scene file.", path);
+        close(fd);
+        return false;
+    }
+
+    auto file = std::make_shared<scene_file>();
+    file->size = size_t(st.st_size);
+    auto *base = mmap(nullptr, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        std::println(stderr, "ERROR: Could not map scene file '{}'.", path);
+        return false;
+    }
+    file->base = base;
+
+    auto const &h = *static_cast<file_header const *>(base);
+    if (std::memcmp(h.magic, fileMagic, sizeof(fileMagic)) != 0 ||
+        h.version != fileVersion || h.realSize != sizeof(real) ||
+        h.geometrySize != sizeof(geometry) ||
+        h.textureSize != sizeof(stored_texture) ||
+        h.settingsSize != sizeof(settings)) {
+        std::println(stderr,
+                     "ERROR: Scene file '{}' was written by another version.",
+                     path);
+        return false;
+    }
+    for (int i = 0; i < section_count; ++i) {
+        auto const &entry = h.sections[i];
+        if (entry.offset % sectionAlign != 0 || entry.offset > file->size ||
+            entry.count > (file->size - entry.offset) / sectionElemSize[i]) {
+            std::println(stderr, "ERROR: Scene file '{}' is truncated.", path);
+            return false;
+        }
+    }
+
+    // The tree and the pixels stay in the mapping, only touched on use.
+    file->tree.node_ends = sectionSpan<int>(base, h, section::node_ends);
+    file->tree.boxes = sectionSpan<aabb>(base, h, section::boxes);
+    file->tree.nodes = sectionSpan<bvh::bvh_node>(base, h, section::nodes);
+    file->tree.geoms = sectionSpan<geometry>(base, h, section::geoms);
+
+    auto stored = sectionSpan<stored_texture>(base, h, section::textures);
+    auto pixels = sectionSpan<float>(base, h, section::pixels);
+    auto textureAt = [&](int32_t index) -> texture const * {
+        if (index < 0 || size_t(index) >= stored.size()) return nullptr;
+        // reserved below, so these don't move.
+        return file->textures.data() + index;
+    };
+    file->textures.reserve(stored.size());
+    for (auto const &t : stored) {
+        texture::data d;
+        switch (t.kind) {
+            case texture::tag::solid:
+                d.solid = t.solid;
+                break;
+            case texture::tag::noise:
+                new (&d.noise) texture::noise_data{t.scale};
+                break;
+            case texture::tag::checker:
+                new (&d.checker) texture::checker_data{
+                    t.scale, textureAt(t.even), textureAt(t.odd)};
+                break;
+            case texture::tag::image: {
+                auto floats =
+                    size_t(t.width) * size_t(t.height) * floatsPerPixel;
+                bool inside = t.pixels <= pixels.size() &&
+                              floats <= pixels.size() - t.pixels;
+                new (&d.image) rtw_shared_image{
+                    floats && inside ? pixels.data() + t.pixels : nullptr,
+                    t.width, t.height};
+                break;
+            }
+        }
+        file->textures.emplace_back(t.kind, std::move(d));
+    }
+
+    world = hittable_list();
+    for (auto const &obj : sectionSpan<stored_object>(base, h, objects)) {
+        material::Data d;
+        d.fuzz = obj.param;
+        world.objects.emplace_back(material(obj.tag, d),
+                                   textureAt(obj.texture));
+    }
+    auto selected = sectionSpan<geometry>(base, h, select_geoms);
+    world.selectGeoms.assign(selected.begin(), selected.end());
+    auto cms = sectionSpan<constant_medium>(base, h, media);
+    world.cms.assign(cms.begin(), cms.end());
+    auto albedos = sectionSpan<color>(base, h, media_albedos);
+    world.cmAlbedos.assign(albedos.begin(), albedos.end());
+    world.file = std::move(file);
+
+    s = h.s;
+    return true;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "bvh.h"
+#include "hittable_list.h"
+#include "settings.h"
+#include "texture.h"
+
+// Binary scene file. Holds a hittable_list after prepare moved the bounded
+// geometries to the tree, so that loading it doesn't build anything: the
+// tree and the image textures are used straight from the mapped file, the
+// rest (objects, unbounded geometries, media) is small and copied.
+//
+// The scene is stored relative to the camera (lookfrom is 0, 0, 0), which
+// is how render would transform it anyway. Files are only meant to be read
+// by the same build that wrote them: the version, the size of `real` and of
+// the stored structs are checked on load.
+//
+// NOTE: meshes and instances aren't stored yet, write fails with them.
+struct scene_file {
+    void const *base = nullptr;
+    size_t size = 0;
+
+    bvh::tree_view tree;
+    // Checkers point into this, images into the mapping.
+    std::vector<texture> textures;
+
+    scene_file() = default;
+    scene_file(scene_file const &) = delete;
+    scene_file &operator=(scene_file const &) = delete;
+    ~scene_file();
+
+    // Prepares (a copy of) the world for `s` and writes it. Returns false
+    // and prints why on failure.
+    static bool write(char const *path, hittable_list world, settings s);
+
+    // Replaces `world` and `s` with the ones in the file. Returns false and
+    // prints why on failure.
+    static bool load(char const *path, hittable_list &world, settings &s);
+};
@@ -0,0 +1,312 @@
+#include "scene_text.h"
+
+#include <filesystem>
+#include <fstream>
+#include <print>
+#include <sstream>
+#include <string>
+#include <tracy/Tracy.hpp>
+#include <unordered_map>
+
+#include "constant_medium.h"
+#include "geometry.h"
+#include "hittable.h"
+#include "material.h"
+#include "quad.h"
+#include "sphere.h"
+#include "texture.h"
+#include "transforms.h"
+#include "triangle.h"
+
+namespace {
+struct parser {
+    std::istringstream line;
+    bool ok = true;
+
+    // Textures are leaked, like the ones in main.cc, since lightInfo only
+    // points to them.
+    std::unordered_map<std::string, texture const *> textures{
+        {"white", &detail::white},
+        {"black", &detail::black},
+    };
+    std::unordered_map<std::string, material> materials{
+        {"lambertian", detail::lambertian},
+        {"diffuse_light", detail::diffuse_light},
+        {"isotropic", detail::isotropic},
+    };
+    transform tf = transform(0, vec3(0, 0, 0));
+    bool transformed = false;
+    // Image and mesh files are relative to the scene file.
+    std::filesystem::path dir;
+
+    template <typename T>
+    T read() {
+        T value{};
+        if (!(line >> value)) ok = false;
+        return value;
+    }
+    real number() { return real(read<double>()); }
+    // Sizes and counts, which the renderer divides by or loops up to.
+    int positive() {
+        auto value = read<int>();
+        if (value <= 0) ok = false;
+        return value;
+    }
+    bool flag() {
+        auto word = read<std::string>();
+        if (word != "on" && word != "off") ok = false;
+        return word == "on";
+    }
+    vec3 vector() {
+        auto x = number();
+        auto y = number();
+        auto z = number();
+        return vec3(x, y, z);
+    }
+
+    texture const *textureRef() {
+        auto it = textures.find(read<std::string>());
+        if (it == textures.end()) ok = false;
+        return ok ? it->second : nullptr;
+    }
+    material materialRef() {
+        auto it = materials.find(read<std::string>());
+        if (it == materials.end()) {
+            ok = false;
+            return detail::lambertian;
+        }
+        return it->second;
+    }
+
+    geometry place(geometry g) {
+        if (transformed) g.applyTransform(tf);
+        return g;
+    }
+
+    void defineTexture() {
+        auto name = read<std::string>();
+        auto kind = read<std::string>();
+        texture const *tex = nullptr;
+        if (kind == "solid") {
+            tex = new texture(texture::solid(vector()));
+        } else if (kind == "checker") {
+            auto scale = number();
+            auto even = textureRef();
+            auto odd = textureRef();
+            tex = new texture(texture::checker(scale, even, odd));
+        } else if (kind == "image") {
+            auto name = read<std::string>();
+            // Names that aren't next to the scene are left to rtw_image's
+            // own search (RTW_IMAGES, then images/ directories).
+            auto file = dir / name;
+            if (!std::filesystem::exists(file)) file = name;
+            tex = new texture(texture::image(file.c_str()));
+        } else if (kind == "noise") {
+            tex = new texture(texture::noise(number()));
+        } else {
+            ok = false;
+        }
+        if (ok) textures[name] = tex;
+    }
+
+    void defineMaterial() {
+        auto name = read<std::string>();
+        auto kind = read<std::string>();
+        if (kind == "metal") {
+            materials.insert_or_assign(name, material::metal(number()));
+        } else if (kind == "dielectric") {
+            materials.insert_or_assign(name, material::dielectric(number()));
+        } else {
+            ok = false;
+        }
+    }
+
+    void setTransform() {
+        auto angle = number();
+        auto offset = vector();
+        tf = transform(angle, offset);
+        transformed = angle != 0 || offset.length_squared() != 0;
+    }
+
+    void primitive(std::string const &kind, hittable_list &world) {
+        auto mat = materialRef();
+        auto tex = textureRef();
+        if (kind == "sphere") {
+            auto center = vector();
+            auto radius = number();
+            world.add(lightInfo(mat, tex), place(sphere(center, radius)));
+        } else if (kind == "moving_sphere") {
+            auto center1 = vector();
+            auto center2 = vector();
+            auto radius = number();
+            world.add(lightInfo(mat, tex),
+                      place(sphere(center1, center2, radius)));
+        } else if (kind == "quad") {
+            auto q = vector();
+            auto u = vector();
+            auto v = vector();
+            world.add(lightInfo(mat, tex), place(quad(q, u, v)));
+        } else {
+            auto a = vector();
+            auto b = vector();
+            world.add(lightInfo(mat, tex), place(aabb(a, b)));
+        }
+    }
+
+    void meshFile(hittable_list &world) {
+        auto mat = materialRef();
+        auto tex = textureRef();
+        auto file = read<std::string>();
+        if (!ok) return;
+        auto m = mesh::load_obj((dir / file).c_str());
+        if (!m) {
+            ok = false;
+            return;
+        }
+        if (transformed) m->applyTransform(tf);
+        world.add(lightInfo(mat, tex), std::move(m));
+    }
+
+    void medium(hittable_list &world) {
+        auto density = number();
+        auto albedo = vector();
+        auto kind = read<std::string>();
+        geometry boundary = aabb(point3(0, 0, 0), point3(0, 0, 0));
+        if (kind == "sphere") {
+            auto center = vector();
+            boundary = sphere(center, number());
+        } else if (kind == "box") {
+            auto a = vector();
+            boundary = aabb(a, vector());
+        } else {
+            ok = false;
+        }
+        if (!ok) return;
+        world.add(constant_medium(
+                      traversable_geometry::from_geometry(place(boundary)),
+                      density),
+                  albedo);
+    }
+
+    void statement(std::string const &word, hittable_list &world,
+                   settings &s) {
+        if (word == "image_width") {
+            s.image_width = positive();
+        } else if (word == "samples_per_pixel") {
+            s.samples_per_pixel = positive();
+        } else if (word == "max_depth") {
+            s.max_depth = positive();
+        } else if (word == "roulette_depth") {
+            s.roulette_depth = read<int>();
+        } else if (word == "seed") {
+            s.seed = read<unsigned int>();
+        } else if (word == "tile_size") {
+            s.tile_size = positive();
+        } else if (word == "adaptive_min_samples") {
+            s.adaptive_min_samples = positive();
+        } else if (word == "adaptive_max_factor") {
+            s.adaptive_max_factor = positive();
+        } else if (word == "adaptive_threshold") {
+            s.adaptive_threshold = number();
+        } else if (word == "adaptive") {
+            s.adaptive = flag();
+        } else if (word == "packet_primary") {
+            s.packet_primary = flag();
+        } else if (word == "wavefront") {
+            s.wavefront = flag();
+        } else if (word == "leaf_blocks") {
+            s.leaf_blocks = flag();
+        } else if (word == "light_sampling") {
+            s.light_sampling = flag();
+        } else if (word == "aspect_ratio") {
+            s.aspect_ratio = number();
+        } else if (word == "vfov") {
+            s.vfov = number();
+        } else if (word == "defocus_angle") {
+            s.defocus_angle = number();
+        } else if (word == "focus_dist") {
+            s.focus_dist = number();
+        } else if (word == "background") {
+            s.background = vector();
+        } else if (word == "lookfrom") {
+            s.lookfrom = vector();
+        } else if (word == "lookat") {
+            s.lookat = vector();
+        } else if (word == "vup") {
+            s.vup = vector();
+        } else if (word == "layout") {
+            auto layout = read<std::string>();
+            if (layout == "binary") {
+                s.layout = tree_layout::binary;
+            } else if (layout == "wide") {
+                s.layout = tree_layout::wide;
+            } else if (layout == "compact") {
+                s.layout = tree_layout::compact;
+            } else {
+                ok = false;
+            }
+        } else if (word == "sampler") {
+            auto kind = read<std::string>();
+            if (kind == "independent") {
+                s.sampler = sampler_kind::independent;
+            } else if (kind == "stratified") {
+                s.sampler = sampler_kind::stratified;
+            } else if (kind == "sobol") {
+                s.sampler = sampler_kind::sobol;
+            } else if (kind == "rank1") {
+                s.sampler = sampler_kind::rank1;
+            } else {
+                ok = false;
+            }
+        } else if (word == "texture") {
+            defineTexture();
+        } else if (word == "material") {
+            defineMaterial();
+        } else if (word == "transform") {
+            setTransform();
+        } else if (word == "sphere" || word == "moving_sphere" ||
+                   word == "quad" || word == "box") {
+            primitive(word, world);
+        } else if (word == "mesh") {
+            meshFile(world);
+        } else if (word == "medium") {
+            medium(world);
+        } else {
+            ok = false;
+        }
+    }
+};
+}  // namespace
+
+bool scene_text::load(char const *path, hittable_list &world, settings &s) {
+    ZoneScopedN("scene text load");
+    std::ifstream in(path);
+    if (!in) {
+        std::println(stderr, "ERROR: Could not open scene '{}'.", path);
+        return false;
+    }
+
+    parser p;
+    p.dir = std::filesystem::path(path).parent_path();
+    std::string text;
+    for (int lineNumber = 1; std::getline(in, text); ++lineNumber) {
+        if (auto comment = text.find('#'); comment != std::string::npos) {
+            text.erase(comment);
+        }
+        p.line.clear();
+        p.line.str(text);
+
+        std::string word;
+        if (!(p.line >> word)) continue;  // blank line
+        p.statement(word, world, s);
+
+        std::string extra;
+        if (p.ok && p.line >> extra) p.ok = false;
+        if (!p.ok) {
+            std::println(stderr, "ERROR: {}:{}: could not parse '{}'.", path,
+                         lineNumber, text);
+            return false;
+        }
+    }
+    return true;
+}
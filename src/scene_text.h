@@ -0,0 +1,49 @@
+#pragma once
+
+#include "hittable_list.h"
+#include "settings.h"
+
+// Scene description in a line based text format, so that scenes can be
+// changed without recompiling. One statement per line, `#` starts a
+// comment:
+//
+//   image_width 400            (also samples_per_pixel, max_depth,
+//                               roulette_depth, seed)
+//   aspect_ratio 1.5           (also vfov, defocus_angle, focus_dist)
+//   background 0.7 0.8 1       (also lookfrom, lookat, vup)
+//   tile_size 32               (also adaptive_min_samples,
+//                               adaptive_max_factor)
+//   adaptive_threshold 0.02
+//   adaptive on                (also packet_primary, wavefront, leaf_blocks,
+//                               light_sampling; on or off)
+//   layout wide                (binary, wide or compact)
+//   sampler sobol              (independent, stratified, sobol or rank1)
+//
+//   texture <name> solid <r> <g> <b>
+//   texture <name> checker <scale> <even texture> <odd texture>
+//   texture <name> image <file>
+//   texture <name> noise <scale>
+//   material <name> metal <fuzz>
+//   material <name> dielectric <refraction index>
+//
+//   transform <y angle> <x> <y> <z>
+//   sphere <material> <texture> <x> <y> <z> <radius>
+//   moving_sphere <material> <texture> <x> <y> <z> <x2> <y2> <z2> <radius>
+//   quad <material> <texture> <x> <y> <z> <ux> <uy> <uz> <vx> <vy> <vz>
+//   box <material> <texture> <x0> <y0> <z0> <x1> <y1> <z1>
+//   mesh <material> <texture> <file.obj>   (see mesh::load_obj)
+//   medium <density> <r> <g> <b> sphere <x> <y> <z> <radius>
+//   medium <density> <r> <g> <b> box <x0> <y0> <z0> <x1> <y1> <z1>
+//
+// Textures and materials must be defined before use. `white` and `black`,
+// and the `lambertian`, `diffuse_light` and `isotropic` materials always
+// exist. The last `transform` applies to every primitive after it;
+// `transform 0 0 0 0` goes back to none. Image and mesh files are looked
+// up next to the scene file (images also where rtw_image looks). The sizes
+// and sample counts (image_width, samples_per_pixel, max_depth, tile_size,
+// adaptive_min_samples, adaptive_max_factor) must be positive.
+struct scene_text {
+    // Adds the primitives to `world` and sets `s`. Returns false and prints
+    // the line on parse errors.
+    static bool load(char const *path, hittable_list &world, settings &s);
+};
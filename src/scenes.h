@@ -0,0 +1,23 @@
+#pragma once
+
+#include <span>
+
+#include "hittable_list.h"
+#include "settings.h"
+
+// A world and how to render it.
+struct scene {
+    hittable_list world;
+    settings s;
+};
+
+// The scenes of the books plus instanced_forest (12), by number (main's
+// --scene). Unknown numbers are the final scene at a medium quality.
+scene builtin_scene(int which);
+
+struct builtin_info {
+    char const *name;
+    int which;
+};
+// Every distinct built-in scene, once.
+std::span<builtin_info const> builtin_scenes();
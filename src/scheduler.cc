@@ -0,0 +1,77 @@
+#include "scheduler.h"
+
+#include <algorithm>
+#include <cstdint>
+
+// Interleaves the bits of x and y (x in the even bits).
+static uint32_t morton(uint32_t x, uint32_t y) {
+    auto spread = [](uint32_t v) {
+        v &= 0xffff;
+        v = (v | (v << 8)) & 0x00ff00ff;
+        v = (v | (v << 4)) & 0x0f0f0f0f;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    };
+    return spread(x) | (spread(y) << 1);
+}
+
+tile_scheduler::tile_scheduler(int width, int height, int tile_size,
+                               int workers) {
+    auto tilesX = (width + tile_size - 1) / tile_size;
+    auto tilesY = (height + tile_size - 1) / tile_size;
+
+    struct keyed {
+        uint32_t key;
+        tile t;
+    };
+    std::vector<keyed> order;
+    order.reserve(tilesX * tilesY);
+    for (int ty = 0; ty < tilesY; ++ty) {
+        for (int tx = 0; tx < tilesX; ++tx) {
+            tile t{tx * tile_size, ty * tile_size,
+                   std::min(width, (tx + 1) * tile_size),
+                   std::min(height, (ty + 1) * tile_size)};
+            order.push_back({morton(tx, ty), t});
+        }
+    }
+    std::sort(order.begin(), order.end(),
+              [](keyed const &a, keyed const &b) { return a.key < b.key; });
+
+    count = int(order.size());
+    workers = std::max(workers, 1);
+    queues.reserve(workers);
+    for (int w = 0; w < workers; ++w) {
+        auto q = std::make_unique<queue>();
+        auto begin = size_t(count) * w / workers;
+        auto end = size_t(count) * (w + 1) / workers;
+        for (auto i = begin; i < end; ++i) q->tiles.emplace_back(order[i].t);
+        queues.emplace_back(std::move(q));
+    }
+}
+
+bool tile_scheduler::next(int worker, tile &out) {
+    {
+        auto &own = *queues[worker];
+        std::lock_guard guard(own.lock);
+        if (!own.tiles.empty()) {
+            out = own.tiles.front();
+            own.tiles.pop_front();
+            return true;
+        }
+    }
+
+    // Steal from the back, which is the furthest from where the owner is
+    // working right now.
+    auto workers = int(queues.size());
+    for (int i = 1; i < workers; ++i) {
+        auto &victim = *queues[(worker + i) % workers];
+        std::lock_guard guard(victim.lock);
+        if (!victim.tiles.empty()) {
+            out = victim.tiles.back();
+            victim.tiles.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
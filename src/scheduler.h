@@ -0,0 +1,35 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Pixel rectangle [x0, x1) x [y0, y1).
+struct tile {
+    int x0, y0;
+    int x1, y1;
+};
+
+// Hands out the image in square tiles. Tiles are laid out in Morton order and
+// split in contiguous runs, one per worker, so that each worker stays in the
+// same region of the scene (and of the BVH/textures). A worker that runs out
+// of tiles steals from the back of another worker's queue.
+struct tile_scheduler {
+    tile_scheduler(int width, int height, int tile_size, int workers);
+
+    // Returns false once there are no tiles left anywhere.
+    bool next(int worker, tile &out);
+
+    int tileCount() const { return count; }
+
+   private:
+    struct alignas(64) queue {
+        std::mutex lock;
+        std::deque<tile> tiles;
+    };
+
+    // NOTE: queues hold a mutex, so they can't live in the vector directly.
+    std::vector<std::unique_ptr<queue>> queues;
+    int count;
+};
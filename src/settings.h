@@ -14,6 +14,21 @@
 #include "color.h"
 #include "vec3.h"
 
+// Layout used to traverse the object tree while rendering.
+enum class tree_layout {
+    binary,  // the pre-order tree as built by bvh::tree_builder.
+    wide,    // collapsed 4-wide tree, tested with AVX2 (bvh::wide_tree).
+    compact,  // wide tree with 8 bit quantized bounds (bvh::compact_tree).
+};
+
+// How the samples of a pixel spread their random numbers (see sampler.h).
+enum class sampler_kind {
+    independent,  // uncorrelated numbers.
+    stratified,   // jittered strata, multi-jittered for pairs (Kensler).
+    sobol,        // Owen scrambled Sobol (0, 2) sequence, per pair.
+    rank1,        // R2 lattice shifted by a noise per pixel.
+};
+
 struct settings {
     // @cleanup these might be duplicated as scene settings that are used by
     // renderer
@@ -23,14 +38,46 @@ struct settings {
     color background;            // Scene background color
 
     // Ratio of image width over height. NOTE: Not used during render.
-    double aspect_ratio = 1.0;
+    real aspect_ratio = 1.0;
 
-    double vfov = 90;                   // Vertical view angle (field of view)
+    real vfov = 90;                   // Vertical view angle (field of view)
     point3 lookfrom = point3(0, 0, 0);  // Point camera is looking from
     point3 lookat = point3(0, 0, -1);   // Point camera is looking at
     vec3 vup = vec3(0, 1, 0);           // Camera-relative "up" direction
 
-    double defocus_angle = 0;  // Variation angle of rays through each pixel
-    double focus_dist =
+    real defocus_angle = 0;  // Variation angle of rays through each pixel
+    real focus_dist =
         10;  // Distance from camera lookfrom point to plane of perfect focus
+
+    tree_layout layout = tree_layout::wide;
+    // Keep SoA copies of the spheres and triangles so that leaves test 4 at a
+    // time (see sphere_block.h, triangle.h).
+    bool leaf_blocks = true;
+    // Trace camera rays in packets (see bvh::tree::hitPacket).
+    bool packet_primary = false;
+    // Render by stages over batches of paths (see wavefront.h).
+    bool wavefront = false;
+    // Next event estimation: lambertian bounces also sample a light, and the
+    // two are weighted with MIS (see light.h).
+    bool light_sampling = true;
+    // Russian roulette: after this many bounces, a path whose throughput is
+    // under 1 goes on with that probability (at least 5%), and what it finds
+    // afterwards is divided by it. Negative disables it. Textures other than
+    // solids count as 1 in that throughput (see roulette_attenuation).
+    int roulette_depth = 3;
+    // Side of the square tiles handed to each worker, in pixels.
+    int tile_size = 32;
+
+    // Stop sampling a pixel once its relative standard error is under
+    // adaptive_threshold, and spend the leftover budget on noisier pixels.
+    // samples_per_pixel is then the average budget. Ignored by wavefront.
+    bool adaptive = false;
+    real adaptive_threshold = 0.02;
+    int adaptive_min_samples = 16;  // Also the batch size
+    int adaptive_max_factor = 4;    // Max samples, in samples_per_pixel
+
+    sampler_kind sampler = sampler_kind::sobol;
+    // Key of the random streams of the samples (see rng::begin_sample). The
+    // image only depends on this, not on the threads or the tiles.
+    unsigned int seed = 0;
 };
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <immintrin.h>
+
+#include <cstdint>
+#include <cstring>
+
+#include "real.h"
+
+// Thin wrappers over the AVX2 lanes used by the wide kernels (wide BVH nodes,
+// packets, sphere blocks). Keeping them here means the kernels read like
+// scalar code and don't spell out the intrinsic names everywhere.
+//
+// Lanes hold `real`s. In single precision the same 4 lanes fit in an SSE
+// register.
+namespace simd {
+
+static constexpr int width = 4;
+
+// 4 int32 lanes, e.g. the indices of a gather. The same in both precisions.
+using i4 = __m128i;
+
+inline i4 broadcast_int(int32_t x) { return _mm_set1_epi32(x); }
+inline i4 add(i4 a, i4 b) { return _mm_add_epi32(a, b); }
+inline i4 bit_and(i4 a, i4 b) { return _mm_and_si128(a, b); }
+inline i4 bit_xor(i4 a, i4 b) { return _mm_xor_si128(a, b); }
+// base[index] of every lane.
+inline i4 gather(int32_t const *base, i4 index) {
+    return _mm_i32gather_epi32(base, index, sizeof(int32_t));
+}
+
+#ifdef RTWK_SINGLE_PRECISION
+
+using v4 = __m128;
+
+inline v4 broadcast(real x) { return _mm_set1_ps(x); }
+inline v4 load(real const *p) { return _mm_load_ps(p); }
+inline v4 loadu(real const *p) { return _mm_loadu_ps(p); }
+inline void store(real *p, v4 v) { _mm_store_ps(p, v); }
+
+// Widens 4 consecutive bytes into 4 lanes.
+inline v4 from_u8(uint8_t const *p) {
+    int32_t packed;
+    std::memcpy(&packed, p, sizeof(packed));
+    return _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed)));
+}
+
+inline v4 min(v4 a, v4 b) { return _mm_min_ps(a, b); }
+inline v4 max(v4 a, v4 b) { return _mm_max_ps(a, b); }
+inline v4 sqrt(v4 a) { return _mm_sqrt_ps(a); }
+
+inline v4 less(v4 a, v4 b) { return _mm_cmplt_ps(a, b); }
+inline v4 less_eq(v4 a, v4 b) { return _mm_cmple_ps(a, b); }
+
+inline v4 mask_and(v4 a, v4 b) { return _mm_and_ps(a, b); }
+
+inline v4 select(v4 mask, v4 a, v4 b) { return _mm_blendv_ps(a, b, mask); }
+
+inline int bits(v4 mask) { return _mm_movemask_ps(mask); }
+
+inline v4 floor(v4 a) { return _mm_floor_ps(a); }
+inline v4 abs(v4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+// Truncates towards zero.
+inline i4 to_int(v4 a) { return _mm_cvttps_epi32(a); }
+inline v4 gather(real const *base, i4 index) {
+    return _mm_i32gather_ps(base, index, sizeof(real));
+}
+
+#else
+
+using v4 = __m256d;
+
+inline v4 broadcast(real x) { return _mm256_set1_pd(x); }
+inline v4 load(real const *p) { return _mm256_load_pd(p); }
+inline v4 loadu(real const *p) { return _mm256_loadu_pd(p); }
+inline void store(real *p, v4 v) { _mm256_store_pd(p, v); }
+
+// Widens 4 consecutive bytes into 4 lanes.
+inline v4 from_u8(uint8_t const *p) {
+    int32_t packed;
+    std::memcpy(&packed, p, sizeof(packed));
+    return _mm256_cvtepi32_pd(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed)));
+}
+
+inline v4 min(v4 a, v4 b) { return _mm256_min_pd(a, b); }
+inline v4 max(v4 a, v4 b) { return _mm256_max_pd(a, b); }
+inline v4 sqrt(v4 a) { return _mm256_sqrt_pd(a); }
+
+// Lane-wise comparisons return a full mask per lane.
+inline v4 less(v4 a, v4 b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+inline v4 less_eq(v4 a, v4 b) { return _mm256_cmp_pd(a, b, _CMP_LE_OQ); }
+
+inline v4 mask_and(v4 a, v4 b) { return _mm256_and_pd(a, b); }
+
+// Picks `b` where `mask` is set and `a` otherwise.
+inline v4 select(v4 mask, v4 a, v4 b) { return _mm256_blendv_pd(a, b, mask); }
+
+// One bit per lane, lane 0 in the lowest bit.
+inline int bits(v4 mask) { return _mm256_movemask_pd(mask); }
+
+inline v4 floor(v4 a) { return _mm256_floor_pd(a); }
+inline v4 abs(v4 a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+// Truncates towards zero.
+inline i4 to_int(v4 a) { return _mm256_cvttpd_epi32(a); }
+// base[index] of every lane.
+inline v4 gather(real const *base, i4 index) {
+    return _mm256_i32gather_pd(base, index, sizeof(real));
+}
+
+#endif
+
+}  // namespace simd
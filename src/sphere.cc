@@ -5,13 +5,13 @@
 #include "hittable.h"
 #include "trace_colors.h"
 
-point3 sphere_center(sphere const &sph, double time) {
+point3 sphere_center(sphere const &sph, real time) {
     // Linearly interpolate from center1 to center2 according to time, where
     // t=0 yields center1, and t=1 yields center2.
     return sph.center1 + time * sph.center_vec;
 }
 
-double sphere::hit(timed_ray r) const {
+real sphere::hit(timed_ray r) const {
     ZoneNamedN(_tracy, "sphere hit", filters::hit);
     point3 center = sphere_center(*this, r.time);
     vec3 oc = center - r.r.orig;
@@ -41,6 +41,37 @@ double sphere::hit(timed_ray r) const {
     return root;
 }
 
+simd::v4 sphere::hit(ray_packet const &p) const {
+    ZoneNamedN(_tracy, "sphere packet hit", filters::hit);
+    // NOTE: @cutnpaste from sphere::hit, with one ray per lane.
+    auto time = simd::load(p.time);
+    auto ocx = simd::broadcast(center1.x()) +
+               time * simd::broadcast(center_vec.x()) - simd::load(p.ox);
+    auto ocy = simd::broadcast(center1.y()) +
+               time * simd::broadcast(center_vec.y()) - simd::load(p.oy);
+    auto ocz = simd::broadcast(center1.z()) +
+               time * simd::broadcast(center_vec.z()) - simd::load(p.oz);
+    auto dx = simd::load(p.dx);
+    auto dy = simd::load(p.dy);
+    auto dz = simd::load(p.dz);
+
+    auto a = dx * dx + dy * dy + dz * dz;
+    auto oc_alongside_ray = dx * ocx + dy * ocy + dz * ocz;
+    auto c = ocx * ocx + ocy * ocy + ocz * ocz -
+             simd::broadcast(radius * radius);
+
+    auto discriminant = oc_alongside_ray * oc_alongside_ray - a * c;
+    auto zero = simd::broadcast(0);
+    auto missed = simd::less(discriminant, zero);
+
+    auto sqrtd = simd::sqrt(simd::max(discriminant, zero));
+    auto inside = simd::less(c, simd::broadcast(minRayDist));
+    auto selectedSqrt = simd::select(inside, zero - sqrtd, sqrtd);
+    auto root = (oc_alongside_ray + selectedSqrt) / a;
+
+    return simd::select(missed, root, zero);
+}
+
 interval sphere::traverse(timed_ray r) const {
     // NOTE: @cutnpaste from sphere::hit
     ZoneNamedNC(_tracy, "sphere traverse", Ctp::Mantle, filters::hit);
@@ -93,7 +124,7 @@ aabb sphere::bounding_box() const {
     return aabb(box1, box2);
 }
 
-vec3 sphere::getNormal(point3 const intersection, double time) const {
+vec3 sphere::getNormal(point3 const intersection, real time) const {
     return (intersection - sphere_center(*this, time)) / radius;
 }
 
@@ -16,6 +16,7 @@
 #include <ray.h>
 #include <vec3.h>
 
+#include "packet.h"
 #include "transforms.h"
 
 // TODO: To instantiate spheres, I should separate instantiatable things
@@ -24,26 +25,32 @@
 // these 'instantiate buffers' must also be separated.
 struct sphere final {
     // Stationary Sphere
-    sphere(point3 const &center, double radius)
+    sphere(point3 const &center, real radius)
         : center1(center), radius(fmax(0, radius)) {}
 
     // Moving Sphere
-    sphere(point3 const &center1, point3 const &center2, double radius)
+    sphere(point3 const &center1, point3 const &center2, real radius)
         : center1(center1), radius(fmax(0, radius)) {
         center_vec = center2 - center1;
     }
 
-    double hit(timed_ray r) const;
+    real hit(timed_ray r) const;
+    // Same as hit(), for every lane of the packet.
+    simd::v4 hit(ray_packet const &p) const;
     interval traverse(timed_ray r) const;
     static uvs getUVs(vec3 normal);
 
-    vec3 getNormal(point3 const intersection, double time) const;
+    vec3 getNormal(point3 const intersection, real time) const;
 
     aabb bounding_box() const;
 
     static sphere applyTransform(sphere a, transform tf) noexcept;
 
     point3 center1;
-    double radius;
+    real radius;
     vec3 center_vec;
 };
+
+// Center of the sphere at `time`, moving spheres go from center1 at 0 to
+// center1 + center_vec at 1.
+point3 sphere_center(sphere const &sph, real time);
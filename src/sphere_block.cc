@@ -0,0 +1,64 @@
+#include "sphere_block.h"
+
+#include <algorithm>
+#include <tracy/Tracy.hpp>
+
+#include "hittable.h"
+#include "trace_colors.h"
+
+std::vector<sphere_block> sphere_block::build(
+    std::span<sphere const> spheres) {
+    ZoneScopedN("sphere blocks build");
+    std::vector<sphere_block> blocks((spheres.size() + width - 1) / width);
+    for (auto &b : blocks) {
+        std::ranges::fill(b.radius2, -1);
+    }
+
+    for (size_t i = 0; i < spheres.size(); ++i) {
+        auto const &sph = spheres[i];
+        auto &b = blocks[i / width];
+        auto lane = i % width;
+        b.cx[lane] = sph.center1.x();
+        b.cy[lane] = sph.center1.y();
+        b.cz[lane] = sph.center1.z();
+        b.mx[lane] = sph.center_vec.x();
+        b.my[lane] = sph.center_vec.y();
+        b.mz[lane] = sph.center_vec.z();
+        b.radius2[lane] = sph.radius * sph.radius;
+    }
+    return blocks;
+}
+
+simd::v4 sphere_block::hit(timed_ray const &r, simd::v4 const maxT) const {
+    ZoneNamedN(_tracy, "sphere block hit", filters::hit);
+    // NOTE: @cutnpaste from sphere::hit, with one sphere per lane.
+    auto time = simd::broadcast(r.time);
+    auto ocx = simd::load(cx) + time * simd::load(mx) -
+               simd::broadcast(r.r.orig.x());
+    auto ocy = simd::load(cy) + time * simd::load(my) -
+               simd::broadcast(r.r.orig.y());
+    auto ocz = simd::load(cz) + time * simd::load(mz) -
+               simd::broadcast(r.r.orig.z());
+    auto dx = simd::broadcast(r.r.dir.x());
+    auto dy = simd::broadcast(r.r.dir.y());
+    auto dz = simd::broadcast(r.r.dir.z());
+
+    auto a = simd::broadcast(r.r.dir.length_squared());
+    auto oc_alongside_ray = dx * ocx + dy * ocy + dz * ocz;
+    auto r2 = simd::load(radius2);
+    auto c = ocx * ocx + ocy * ocy + ocz * ocz - r2;
+
+    auto discriminant = oc_alongside_ray * oc_alongside_ray - a * c;
+    auto zero = simd::broadcast(0);
+    auto sqrtd = simd::sqrt(simd::max(discriminant, zero));
+    auto inside = simd::less(c, simd::broadcast(minRayDist));
+    auto selectedSqrt = simd::select(inside, zero - sqrtd, sqrtd);
+    auto root = (oc_alongside_ray + selectedSqrt) / a;
+
+    auto valid = simd::mask_and(
+        simd::mask_and(simd::less_eq(zero, discriminant),
+                       simd::less_eq(zero, r2)),
+        simd::mask_and(simd::less_eq(simd::broadcast(minRayDist), root),
+                       simd::less_eq(root, maxT)));
+    return simd::select(valid, maxT, root);
+}
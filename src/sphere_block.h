@@ -0,0 +1,31 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "ray.h"
+#include "simd.h"
+#include "sphere.h"
+
+// `width` consecutive spheres as SoA lanes, so that a leaf tests all of them
+// with one kernel. Padding lanes have a negative `radius2` and never hit.
+struct sphere_block {
+    static constexpr int width = simd::width;
+
+    alignas(32) real cx[width];
+    alignas(32) real cy[width];
+    alignas(32) real cz[width];
+    // center_vec, for moving spheres.
+    alignas(32) real mx[width];
+    alignas(32) real my[width];
+    alignas(32) real mz[width];
+    alignas(32) real radius2[width];
+
+    // spheres[i] ends up in block i / width, lane i % width. Must be rebuilt
+    // after any change to the spheres (including transforms).
+    static std::vector<sphere_block> build(std::span<sphere const> spheres);
+
+    // Distance to the sphere of every lane, or `maxT` where there's no hit in
+    // [minRayDist, maxT].
+    simd::v4 hit(timed_ray const &r, simd::v4 maxT) const;
+};
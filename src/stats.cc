@@ -0,0 +1,36 @@
+#include "stats.h"
+
+#include <mutex>
+#include <utility>
+
+namespace stats {
+
+counters &counters::operator+=(counters const &other) noexcept {
+    primaryRays += other.primaryRays;
+    rays += other.rays;
+    nodesVisited += other.nodesVisited;
+    primitiveTests += other.primitiveTests;
+    shadowRays += other.shadowRays;
+    return *this;
+}
+
+#ifdef RTWK_STATS
+thread_local counters local;
+#endif
+
+static std::mutex totalsMutex;
+static counters totals;
+
+void flush() noexcept {
+#ifdef RTWK_STATS
+    std::lock_guard lock(totalsMutex);
+    totals += std::exchange(local, {});
+#endif
+}
+
+counters take() noexcept {
+    std::lock_guard lock(totalsMutex);
+    return std::exchange(totals, {});
+}
+
+}  // namespace stats
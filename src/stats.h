@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+
+// Work counters for rt-bench, only compiled in with RTWK_STATS. Every thread
+// counts in its own copy, and adds it to the totals with stats::flush.
+namespace stats {
+
+struct counters {
+    uint64_t primaryRays = 0;
+    // Closest hit queries, primary rays included.
+    uint64_t rays = 0;
+    uint64_t nodesVisited = 0;
+    // Objects tested in the leaves, a block of 4 counts as 4.
+    uint64_t primitiveTests = 0;
+    // Occlusion queries of next event estimation, not counted in `rays`.
+    uint64_t shadowRays = 0;
+
+    counters &operator+=(counters const &other) noexcept;
+};
+
+#ifdef RTWK_STATS
+extern thread_local counters local;
+#define RTWK_COUNT(counter, n) (stats::local.counter += (n))
+#else
+#define RTWK_COUNT(counter, n) ((void)0)
+#endif
+
+// Adds the counters of the calling thread to the totals and clears them.
+void flush() noexcept;
+// Returns the totals and clears them.
+counters take() noexcept;
+
+}  // namespace stats
@@ -3,7 +3,7 @@
 
 #include <tracy/Tracy.hpp>
 
-texture texture::checker(double scale, texture const *even,
+texture texture::checker(real scale, texture const *even,
                          texture const *odd) {
     data d;
     new (&d.checker) checker_data{scale, even, odd};
@@ -24,7 +24,7 @@ texture texture::image(char const *filename) {
     return texture(tag::image, std::move(d));
 }
 
-texture texture::noise(double scale) {
+texture texture::noise(real scale) {
     data d;
     new (&d.noise) noise_data{scale};
     return texture(tag::noise, std::move(d));
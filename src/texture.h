@@ -19,15 +19,15 @@ struct texture {
         solid,
         checker,
         image,
-        noise,
+        noise,  // last, see textureKinds in wavefront.cc
     } kind;
 
     struct noise_data {
-        double scale;
+        real scale;
     };
 
     struct checker_data {
-        double inv_scale;
+        real inv_scale;
         texture const *even;
         texture const *odd;
     };
@@ -46,14 +46,14 @@ struct texture {
     constexpr texture(tag kind, data &&d)
         : kind(kind), as(std::forward<data &&>(d)) {}
 
-    static texture checker(double scale, texture const *even,
+    static texture checker(real scale, texture const *even,
                            texture const *odd);
 
     static texture solid(color col);
 
     static texture image(char const *filename);
 
-    static texture noise(double scale);
+    static texture noise(real scale);
 };
 
 namespace detail {
@@ -1,5 +1,6 @@
 #pragma once
 #include <tracy/Tracy.hpp>
+#include <utility>
 
 #include "interval.h"
 #include "perlin.h"
@@ -19,17 +20,27 @@ inline color sample_image(rtw_shared_image img, uvs uv) {
     auto j = int((1 - uv.v) * img.image_height);
     auto px = img.pixel_data(i, j);
 
-    // NOTE: @coversion from f32 -> f64.
-    // Maybe it's time to drop to floats?
+    // NOTE: @coversion from f32 -> f64, unless built with
+    // RTWK_SINGLE_PRECISION.
     return {px[0], px[1], px[2]};
 }
 
-inline double sample_noise(texture::noise_data const &data, point3 const &p,
-                           perlin const &perlin) {
+// Octaves of the turbulence of the noise textures.
+static constexpr int noiseDepth = 7;
+
+// Gray level of the noise texture at `p`, whose turbulence is `turb`. For
+// when the turbulence was computed with perlin::turb_batch.
+inline real noise_from_turb(texture::noise_data const &data, point3 const &p,
+                            real turb) {
+    return .5 * (1 + std::sin(data.scale * p.z() + 10 * turb));
+}
+
+inline real sample_noise(texture::noise_data const &data, point3 const &p,
+                         perlin const &perlin) {
     ZoneScopedN("noise");
     ZoneColor(Ctp::Blue);
 
-    return .5 * (1 + std::sin(data.scale * p.z() + 10 * perlin.turb(p, 7)));
+    return noise_from_turb(data, p, perlin.turb(p, noiseDepth));
 }
 
 inline texture const *checkerSelect(texture::checker_data const &data,
@@ -50,3 +61,31 @@ inline texture const *traverseChecker(texture const *tex, point3 const &p) {
     }
     return tex;
 }
+
+// What russian roulette counts a checker-resolved `tex` as: its color for a
+// solid, 1 for the kinds that the deferred renderer only evaluates once the
+// samples are traced. Both pipelines use it, so that they stop the same
+// paths and render the same image.
+inline color roulette_attenuation(texture const *tex) {
+    return tex->kind == texture::tag::solid ? tex->as.solid : color(1, 1, 1);
+}
+
+// Color of `tex` right away, for the places that can't defer it (the lights
+// of next event estimation, the wavefront stages).
+inline color sample_texture(texture const *tex, uvs uv, point3 const &p,
+                            perlin const &noise) {
+    tex = traverseChecker(tex, p);
+    switch (tex->kind) {
+        case texture::tag::solid:
+            return tex->as.solid;
+        case texture::tag::noise: {
+            auto gray = sample_noise(tex->as.noise, p, noise);
+            return color(gray, gray, gray);
+        }
+        case texture::tag::image:
+            return sample_image(tex->as.image, uv);
+        case texture::tag::checker:
+            break;
+    }
+    std::unreachable();
+}
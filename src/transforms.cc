@@ -8,7 +8,7 @@
 namespace rotateY {
 
 
-static point3 applyForward(point3 local, double sin_theta, double cos_theta) {
+static point3 applyForward(point3 local, real sin_theta, real cos_theta) {
     auto p = local;
     p[0] = cos_theta * local[0] + sin_theta * local[2];
     p[2] = -sin_theta * local[0] + cos_theta * local[2];
@@ -25,6 +25,30 @@ point3 transform::applyForward(point3 p) const noexcept {
     return p;
 }
 
+point3 transform::applyInverse(point3 p) const noexcept {
+    return rotateInverse(p - offset);
+}
+
+vec3 transform::rotateForward(vec3 v) const noexcept {
+    return rotateY::applyForward(v, sin_theta, cos_theta);
+}
+
+vec3 transform::rotateInverse(vec3 v) const noexcept {
+    return rotateY::applyForward(v, -sin_theta, cos_theta);
+}
+
+transform transform::compose(transform const &outer,
+                             transform const &inner) noexcept {
+    // R_o (R_i p + o_i) + o_o = (R_o R_i) p + (R_o o_i + o_o)
+    transform res;
+    res.sin_theta =
+        outer.sin_theta * inner.cos_theta + outer.cos_theta * inner.sin_theta;
+    res.cos_theta =
+        outer.cos_theta * inner.cos_theta - outer.sin_theta * inner.sin_theta;
+    res.offset = outer.applyForward(inner.offset);
+    return res;
+}
+
 
 aabb transform::applyForward(aabb bbox) const noexcept {
     point3 min(infinity, infinity, infinity);
@@ -52,7 +76,7 @@ aabb transform::applyForward(aabb bbox) const noexcept {
 }
 
 
-transform::transform(double angleDegrees, vec3 offset) noexcept
+transform::transform(real angleDegrees, vec3 offset) noexcept
     : offset(offset) {
     auto angleRad = degrees_to_radians(angleDegrees);
     sin_theta = std::sin(angleRad);
@@ -8,14 +8,23 @@
 
 struct transform final {
     vec3 offset;
-    double sin_theta;
-    double cos_theta;
+    real sin_theta;
+    real cos_theta;
 
     constexpr transform() = default;
 
-    transform(double angleDegrees, vec3 offset) noexcept;
+    transform(real angleDegrees, vec3 offset) noexcept;
 
 
     point3 applyForward(point3 p) const noexcept;
     aabb applyForward(aabb) const noexcept;
+    point3 applyInverse(point3 p) const noexcept;
+
+    // Directions (and normals) are only rotated.
+    vec3 rotateForward(vec3 v) const noexcept;
+    vec3 rotateInverse(vec3 v) const noexcept;
+
+    // `outer` applied after `inner`.
+    static transform compose(transform const &outer,
+                             transform const &inner) noexcept;
 };
\ No newline at end of file
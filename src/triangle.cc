@@ -0,0 +1,229 @@
+#include "triangle.h"
+
+#include <cstdio>
+#include <fstream>
+#include <print>
+#include <sstream>
+#include <string>
+#include <tracy/Tracy.hpp>
+
+#include "hittable.h"
+#include "trace_colors.h"
+
+void mesh::applyTransform(transform tf) noexcept {
+    for (auto &v : vertices) v = tf.applyForward(v);
+    for (auto &n : normals) n = tf.rotateForward(n);
+}
+
+// Index of the vertex in an OBJ face element (`v`, `v/vt`, `v//vn` or
+// `v/vt/vn`), from 0. Negative indices count back from the last vertex.
+static bool objVertex(std::string const &element, size_t vertexCount,
+                      uint32_t &index) {
+    long i = 0;
+    if (std::sscanf(element.c_str(), "%ld", &i) != 1 || i == 0) return false;
+    if (i < 0) i += long(vertexCount) + 1;
+    if (i < 1 || size_t(i) > vertexCount) return false;
+    index = uint32_t(i - 1);
+    return true;
+}
+
+std::shared_ptr<mesh> mesh::load_obj(char const *path) {
+    ZoneScopedN("obj load");
+    std::ifstream in(path);
+    if (!in) {
+        std::println(stderr, "ERROR: Could not open mesh '{}'.", path);
+        return nullptr;
+    }
+
+    auto m = std::make_shared<mesh>();
+    std::string text;
+    for (int lineNumber = 1; std::getline(in, text); ++lineNumber) {
+        std::istringstream line(text);
+        std::string word;
+        line >> word;
+        bool ok = true;
+        if (word == "v") {
+            double x, y, z;
+            ok = bool(line >> x >> y >> z);
+            m->vertices.emplace_back(real(x), real(y), real(z));
+        } else if (word == "f") {
+            std::vector<uint32_t> face;
+            for (std::string element; ok && line >> element;) {
+                uint32_t index = 0;
+                ok = objVertex(element, m->vertices.size(), index);
+                if (ok) face.push_back(index);
+            }
+            ok = ok && face.size() >= 3;
+            for (size_t i = 2; ok && i < face.size(); ++i) {
+                m->indices.insert(m->indices.end(),
+                                  {face[0], face[i - 1], face[i]});
+            }
+        }
+        // everything else (comments, vt, vn, groups, materials) is skipped.
+        if (!ok) {
+            std::println(stderr, "ERROR: {}:{}: could not parse '{}'.", path,
+                         lineNumber, text);
+            return nullptr;
+        }
+    }
+    if (m->indices.empty()) {
+        std::println(stderr, "ERROR: Mesh '{}' has no faces.", path);
+        return nullptr;
+    }
+    return m;
+}
+
+// The ray is considered parallel to the triangle when the determinant is
+// below this fraction of |e1| |e2| |dir|, its largest possible value, so that
+// the test doesn't depend on the size of the mesh.
+static constexpr real parallelDet = 1e-8;
+
+// Smallest determinant of a hit, without the |dir| factor.
+static real detScale(vec3 const &e1, vec3 const &e2) {
+    return parallelDet * std::sqrt(e1.length_squared() * e2.length_squared());
+}
+
+real triangle::hit(ray const &r) const {
+    ZoneNamedN(_tracy, "triangle hit", filters::hit);
+    auto v0 = vertex(0);
+    auto e1 = vertex(1) - v0;
+    auto e2 = vertex(2) - v0;
+
+    auto pvec = cross(r.dir, e2);
+    auto det = dot(e1, pvec);
+    if (std::abs(det) <= detScale(e1, e2) * r.dir.length()) return 0;
+    auto invDet = 1 / det;
+
+    auto tvec = r.orig - v0;
+    auto u = dot(tvec, pvec) * invDet;
+    if (u < 0 || u > 1) return 0;
+
+    auto qvec = cross(tvec, e1);
+    auto v = dot(r.dir, qvec) * invDet;
+    if (v < 0 || u + v > 1) return 0;
+
+    return dot(e2, qvec) * invDet;
+}
+
+// Barycentric coordinates of a point on the triangle, for vertices 1 and 2.
+static uvs barycentric(triangle const &t, point3 p) {
+    auto v0 = t.vertex(0);
+    auto e1 = t.vertex(1) - v0;
+    auto e2 = t.vertex(2) - v0;
+    auto d = p - v0;
+
+    auto d11 = dot(e1, e1);
+    auto d12 = dot(e1, e2);
+    auto d22 = dot(e2, e2);
+    auto dp1 = dot(d, e1);
+    auto dp2 = dot(d, e2);
+    auto invDenom = 1 / (d11 * d22 - d12 * d12);
+
+    uvs b;
+    b.u = (d22 * dp1 - d12 * dp2) * invDenom;
+    b.v = (d11 * dp2 - d12 * dp1) * invDenom;
+    return b;
+}
+
+vec3 triangle::getNormal(point3 intersection) const {
+    if (m->normals.empty()) {
+        return unit_vector(cross(vertex(1) - vertex(0), vertex(2) - vertex(0)));
+    }
+    auto b = barycentric(*this, intersection);
+    auto const *idx = &m->indices[first];
+    return unit_vector((1 - b.u - b.v) * m->normals[idx[0]] +
+                       b.u * m->normals[idx[1]] + b.v * m->normals[idx[2]]);
+}
+
+uvs triangle::getUVs(point3 intersection) const {
+    auto b = barycentric(*this, intersection);
+    if (m->texcoords.empty()) return b;
+
+    auto const *idx = &m->indices[first];
+    auto const &t0 = m->texcoords[idx[0]];
+    auto const &t1 = m->texcoords[idx[1]];
+    auto const &t2 = m->texcoords[idx[2]];
+    auto w = 1 - b.u - b.v;
+    uvs uv;
+    uv.u = w * t0.u + b.u * t1.u + b.v * t2.u;
+    uv.v = w * t0.v + b.u * t1.v + b.v * t2.v;
+    return uv;
+}
+
+aabb triangle::bounding_box() const {
+    return aabb(aabb(vertex(0), vertex(1)), aabb(vertex(2), vertex(2)));
+}
+
+std::vector<triangle_block> triangle_block::build(
+    std::span<triangle const> triangles) {
+    ZoneScopedN("triangle blocks build");
+    // zero initialized, so the padding lanes are degenerate.
+    std::vector<triangle_block> blocks((triangles.size() + width - 1) / width);
+
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        auto const &t = triangles[i];
+        auto v0 = t.vertex(0);
+        auto e1 = t.vertex(1) - v0;
+        auto e2 = t.vertex(2) - v0;
+        auto &b = blocks[i / width];
+        auto lane = i % width;
+        b.v0x[lane] = v0.x();
+        b.v0y[lane] = v0.y();
+        b.v0z[lane] = v0.z();
+        b.e1x[lane] = e1.x();
+        b.e1y[lane] = e1.y();
+        b.e1z[lane] = e1.z();
+        b.e2x[lane] = e2.x();
+        b.e2y[lane] = e2.y();
+        b.e2z[lane] = e2.z();
+        b.minDet[lane] = detScale(e1, e2);
+    }
+    return blocks;
+}
+
+simd::v4 triangle_block::hit(timed_ray const &r, simd::v4 const maxT) const {
+    ZoneNamedN(_tracy, "triangle block hit", filters::hit);
+    // NOTE: @cutnpaste from triangle::hit, with one triangle per lane.
+    auto dx = simd::broadcast(r.r.dir.x());
+    auto dy = simd::broadcast(r.r.dir.y());
+    auto dz = simd::broadcast(r.r.dir.z());
+    auto e1x_ = simd::load(e1x), e1y_ = simd::load(e1y),
+         e1z_ = simd::load(e1z);
+    auto e2x_ = simd::load(e2x), e2y_ = simd::load(e2y),
+         e2z_ = simd::load(e2z);
+
+    // pvec = dir × e2
+    auto px = dy * e2z_ - dz * e2y_;
+    auto py = dz * e2x_ - dx * e2z_;
+    auto pz = dx * e2y_ - dy * e2x_;
+    auto det = e1x_ * px + e1y_ * py + e1z_ * pz;
+
+    auto zero = simd::broadcast(0);
+    auto one = simd::broadcast(1);
+    auto absDet = simd::max(det, zero - det);
+    // strict, so that the zeroed padding lanes are parallel.
+    auto nonParallel = simd::less(
+        simd::load(minDet) * simd::broadcast(r.r.dir.length()), absDet);
+    // keep the parallel lanes finite, they're discarded anyway.
+    auto invDet = one / simd::select(nonParallel, one, det);
+
+    auto tx = simd::broadcast(r.r.orig.x()) - simd::load(v0x);
+    auto ty = simd::broadcast(r.r.orig.y()) - simd::load(v0y);
+    auto tz = simd::broadcast(r.r.orig.z()) - simd::load(v0z);
+    auto u = (tx * px + ty * py + tz * pz) * invDet;
+
+    // qvec = tvec × e1
+    auto qx = ty * e1z_ - tz * e1y_;
+    auto qy = tz * e1x_ - tx * e1z_;
+    auto qz = tx * e1y_ - ty * e1x_;
+    auto v = (dx * qx + dy * qy + dz * qz) * invDet;
+    auto t = (e2x_ * qx + e2y_ * qy + e2z_ * qz) * invDet;
+
+    auto inside = simd::mask_and(
+        simd::mask_and(simd::less_eq(zero, u), simd::less_eq(zero, v)),
+        simd::less_eq(u + v, one));
+    auto inRange = simd::mask_and(simd::less_eq(simd::broadcast(minRayDist), t),
+                                  simd::less_eq(t, maxT));
+    auto valid = simd::mask_and(simd::mask_and(nonParallel, inside), inRange);
+    return simd::select(valid, maxT, t);
+}
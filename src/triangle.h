@@ -0,0 +1,83 @@
+#pragma once
+
+#include <aabb.h>
+#include <ray.h>
+#include <rtweekend.h>
+#include <vec3.h>
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "simd.h"
+#include "transforms.h"
+
+// Indexed triangle mesh. Triangles only keep a pointer to the mesh and their
+// offset in `indices`, so the vertex data is stored once.
+struct mesh {
+    std::vector<point3> vertices;
+    // 3 per triangle.
+    std::vector<uint32_t> indices;
+    // Optional, one per vertex. Without them the triangles are flat shaded
+    // and their UVs are the barycentric coordinates.
+    std::vector<vec3> normals;
+    std::vector<uvs> texcoords;
+
+    constexpr size_t triangleCount() const { return indices.size() / 3; }
+
+    // Moves the vertices (and rotates the normals) of the whole mesh.
+    void applyTransform(transform tf) noexcept;
+
+    // Reads the vertices (`v`) and faces (`f`) of a Wavefront OBJ file.
+    // Faces with more than 3 vertices are split into a fan; texture
+    // coordinates and normals are skipped, so the mesh is flat shaded.
+    // Returns null and prints the line on errors.
+    static std::shared_ptr<mesh> load_obj(char const *path);
+};
+
+struct triangle final {
+    mesh const *m;
+    uint32_t first;  // offset of the first index of this triangle
+
+    constexpr triangle(mesh const *m, uint32_t first) : m(m), first(first) {}
+
+    real hit(ray const &r) const;
+    vec3 getNormal(point3 intersection) const;
+    uvs getUVs(point3 intersection) const;
+    aabb bounding_box() const;
+
+    // The vertices belong to the mesh, which is transformed as a whole with
+    // mesh::applyTransform.
+    static triangle applyTransform(triangle t, transform) noexcept {
+        return t;
+    }
+
+    point3 vertex(int i) const { return m->vertices[m->indices[first + i]]; }
+};
+
+// Möller–Trumbore for `width` triangles at once, stored as a vertex and two
+// edges per lane. Padding lanes have null edges and never hit.
+struct triangle_block {
+    static constexpr int width = simd::width;
+
+    alignas(32) real v0x[width];
+    alignas(32) real v0y[width];
+    alignas(32) real v0z[width];
+    alignas(32) real e1x[width];
+    alignas(32) real e1y[width];
+    alignas(32) real e1z[width];
+    alignas(32) real e2x[width];
+    alignas(32) real e2y[width];
+    alignas(32) real e2z[width];
+    // Below this times |dir| the ray is parallel (see triangle.cc).
+    alignas(32) real minDet[width];
+
+    // triangles[i] ends up in block i / width, lane i % width.
+    static std::vector<triangle_block> build(
+        std::span<triangle const> triangles);
+
+    // Distance to the triangle of every lane, or `maxT` where there's no hit
+    // in [minRayDist, maxT].
+    simd::v4 hit(timed_ray const &r, simd::v4 maxT) const;
+};
@@ -14,20 +14,22 @@
 
 #include <cmath>
 
+#include "real.h"
+
 class vec3 {
    public:
-    double e[3];
+    real e[3];
 
     constexpr vec3() : e{0, 0, 0} {}
-    constexpr vec3(double e0, double e1, double e2) : e{e0, e1, e2} {}
+    constexpr vec3(real e0, real e1, real e2) : e{e0, e1, e2} {}
 
-    constexpr double x() const { return e[0]; }
-    constexpr double y() const { return e[1]; }
-    constexpr double z() const { return e[2]; }
+    constexpr real x() const { return e[0]; }
+    constexpr real y() const { return e[1]; }
+    constexpr real z() const { return e[2]; }
 
     constexpr vec3 operator-() const { return vec3(-e[0], -e[1], -e[2]); }
-    constexpr double operator[](int i) const { return e[i]; }
-    constexpr double &operator[](int i) { return e[i]; }
+    constexpr real operator[](int i) const { return e[i]; }
+    constexpr real &operator[](int i) { return e[i]; }
 
     constexpr vec3 &operator+=(vec3 const &v) {
         e[0] += v.e[0];
@@ -36,18 +38,18 @@ class vec3 {
         return *this;
     }
 
-    constexpr vec3 &operator*=(double t) {
+    constexpr vec3 &operator*=(real t) {
         e[0] *= t;
         e[1] *= t;
         e[2] *= t;
         return *this;
     }
 
-    constexpr vec3 &operator/=(double t) { return *this *= 1 / t; }
+    constexpr vec3 &operator/=(real t) { return *this *= 1 / t; }
 
-    double length() const { return std::sqrt(length_squared()); }
+    real length() const { return std::sqrt(length_squared()); }
 
-    constexpr double length_squared() const {
+    constexpr real length_squared() const {
         return e[0] * e[0] + e[1] * e[1] + e[2] * e[2];
     }
 
@@ -77,15 +79,15 @@ constexpr vec3 operator*(vec3 u, vec3 v) {
     return vec3(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
 }
 
-constexpr vec3 operator*(double t, vec3 v) {
+constexpr vec3 operator*(real t, vec3 v) {
     return vec3(t * v.e[0], t * v.e[1], t * v.e[2]);
 }
 
-constexpr vec3 operator*(vec3 v, double t) { return t * v; }
+constexpr vec3 operator*(vec3 v, real t) { return t * v; }
 
-constexpr vec3 operator/(vec3 v, double t) { return (1 / t) * v; }
+constexpr vec3 operator/(vec3 v, real t) { return (1 / t) * v; }
 
-constexpr double dot(vec3 u, vec3 v) {
+constexpr real dot(vec3 u, vec3 v) {
     return u.e[0] * v.e[0] + u.e[1] * v.e[1] + u.e[2] * v.e[2];
 }
 
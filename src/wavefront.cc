@@ -0,0 +1,246 @@
+#include "wavefront.h"
+
+#include <algorithm>
+#include <span>
+#include <tracy/Tracy.hpp>
+
+#include "light.h"
+#include "material.h"
+#include "renderer.h"
+#include "sampler.h"
+#include "texture_impls.h"
+#include "trace_colors.h"
+
+wavefront_buffers wavefront_buffers::request(int paths, int tile_size) {
+    wavefront_buffers b;
+    for (auto *v : {&b.ox, &b.oy, &b.oz, &b.dx, &b.dy, &b.dz, &b.time,
+                    &b.hitT}) {
+        v->resize(paths);
+    }
+    b.throughput.resize(paths);
+    b.rouletteThroughput.resize(paths);
+    b.pixel.resize(paths);
+    b.depth.resize(paths);
+    b.bouncePdf.resize(paths);
+    b.rng.resize(paths);
+    b.hitGeom.resize(paths);
+    b.medium.resize(paths);
+    b.tex.resize(paths);
+    b.alive.reserve(paths);
+    b.keys.resize(paths);
+    b.queue.resize(paths);
+    b.accum.resize(size_t(tile_size) * tile_size);
+    return b;
+}
+
+static timed_ray rayOf(wavefront_buffers const &b, int slot) {
+    return {ray(point3(b.ox[slot], b.oy[slot], b.oz[slot]),
+                vec3(b.dx[slot], b.dy[slot], b.dz[slot])),
+            b.time[slot]};
+}
+
+static void setRay(wavefront_buffers &b, int slot, ray const &r) {
+    b.ox[slot] = r.orig.x();
+    b.oy[slot] = r.orig.y();
+    b.oz[slot] = r.orig.z();
+    b.dx[slot] = r.dir.x();
+    b.dy[slot] = r.dir.y();
+    b.dz[slot] = r.dir.z();
+}
+
+// Path `path` of tile `t`: the samples of a pixel are consecutive, and the
+// pixels go row by row.
+static void generate(settings const &s, camera const &cam,
+                     wavefront_buffers &b, int slot, tile const &t, int path) {
+    auto const local = path / s.samples_per_pixel;
+    auto const width = t.x1 - t.x0;
+    auto const i = t.x0 + local % width;
+    auto const j = t.y0 + local / width;
+    // same streams as samplePixel, so both pipelines render the same image.
+    rng::begin_sample(s.seed, uint32_t(j * s.image_width + i),
+                      uint32_t(path % s.samples_per_pixel));
+    auto r = get_ray(s, cam, i, j);
+    b.rng[slot] = rng::current();
+    setRay(b, slot, r.r);
+    b.time[slot] = r.time;
+    b.throughput[slot] = color(1, 1, 1);
+    b.rouletteThroughput[slot] = color(1, 1, 1);
+    b.pixel[slot] = local;
+    b.depth[slot] = s.max_depth;
+    b.bouncePdf[slot] = 0;
+}
+
+// Shading buckets: misses, mediums, then one per (material, texture) pair.
+namespace key {
+static constexpr int miss = 0;
+static constexpr int medium = 1;
+// Counted from the last kind of each enum, so new kinds go at the end.
+static constexpr int textureKinds = int(texture::tag::noise) + 1;
+static constexpr int materialKinds = int(material::kind::dielectric) + 1;
+static constexpr int count = 2 + materialKinds * textureKinds;
+
+static int surface(material::kind mat, texture::tag tex) {
+    return 2 + int(mat) * textureKinds + int(tex);
+}
+}  // namespace key
+
+static void intersect(hittable_list const &world, wavefront_buffers &b) {
+    ZoneScopedN("wavefront intersect");
+    for (auto slot : b.alive) {
+        auto r = rayOf(b, slot);
+        auto [res, closestHit] = world.hitSelect(r);
+        auto maxT = res ? closestHit : infinity;
+
+        real cmHit;
+        rng::current() = b.rng[slot];
+        rng::next_bounce();
+        auto *cmColor = world.sampleConstantMediums(r, maxT, &cmHit);
+        b.rng[slot] = rng::current();
+        if (cmColor) {
+            b.medium[slot] = cmColor;
+            b.hitT[slot] = cmHit;
+            b.keys[slot] = key::medium;
+            continue;
+        }
+        b.medium[slot] = nullptr;
+        b.hitGeom[slot] = res;
+        b.hitT[slot] = closestHit;
+
+        if (!res) {
+            b.keys[slot] = key::miss;
+            continue;
+        }
+
+        auto const &[mat, tex] = world.objects[res.relIndex];
+        auto resolved = traverseChecker(tex, r.r.at(closestHit));
+        b.tex[slot] = resolved;
+        b.keys[slot] = key::surface(mat.tag, resolved->kind);
+    }
+}
+
+// Counting sort of the alive slots by their shading key, so that each bucket
+// runs as a tight loop over a single material and texture.
+static void sortByKey(wavefront_buffers &b) {
+    ZoneScopedN("wavefront sort");
+    int offsets[key::count + 1] = {};
+    for (auto slot : b.alive) ++offsets[b.keys[slot] + 1];
+    for (int k = 0; k < key::count; ++k) offsets[k + 1] += offsets[k];
+    for (auto slot : b.alive) b.queue[offsets[b.keys[slot]]++] = slot;
+}
+
+// Russian roulette after a bounce, which scales up the throughput of the
+// paths that go on.
+static bool survives(settings const &s, sampler const &smp,
+                     wavefront_buffers &b, int slot) {
+    auto q = russian_roulette(s, smp, s.max_depth - b.depth[slot],
+                              b.rouletteThroughput[slot]);
+    if (q == 0) return false;
+    b.throughput[slot] /= q;
+    b.rouletteThroughput[slot] /= q;
+    return true;
+}
+
+// Returns whether the path is still alive.
+static bool shade(settings const &s, hittable_list const &world,
+                  sampler const &smp, wavefront_buffers &b, int slot,
+                  perlin const &noise) {
+    auto r = rayOf(b, slot);
+
+    if (b.keys[slot] == key::miss) {
+        b.accum[b.pixel[slot]] += b.throughput[slot] * s.background;
+        return false;
+    }
+
+    if (b.keys[slot] == key::medium) {
+        // Don't need UVs/normal; we have an isotropic material.
+        auto dir = uniform_sphere(smp.get2D());
+        setRay(b, slot, ray(r.r.at(b.hitT[slot]), dir));
+        b.throughput[slot] = b.throughput[slot] * *b.medium[slot];
+        b.rouletteThroughput[slot] =
+            b.rouletteThroughput[slot] * *b.medium[slot];
+        b.bouncePdf[slot] = 0;
+        return --b.depth[slot] > 0 && survives(s, smp, b, slot);
+    }
+
+    auto res = b.hitGeom[slot];
+    auto p = r.r.at(b.hitT[slot]);
+    auto normal = res.getNormal(p, r.time);
+    auto front_face = set_face_normal(r.r.dir, normal);
+    auto uv = res.getUVs(p, normal);
+    // the checkers were resolved in the intersect stage.
+    auto attenuation = sample_texture(b.tex[slot], uv, p, noise);
+
+    auto const &mat = world.objects[res.relIndex].mat;
+    if (mat.tag == material::kind::diffuse_light) {
+        real weight = 1;
+        if (b.bouncePdf[slot] > 0) {
+            // the ray starts at the lambertian point.
+            weight = bounce_weight(world, res.relIndex, r.r.orig, p, r.time,
+                                   b.bouncePdf[slot]);
+        }
+        b.accum[b.pixel[slot]] += b.throughput[slot] * attenuation * weight;
+        return false;
+    }
+
+    vec3 scattered;
+    if (!mat.scatter(r.r.dir, normal, front_face, smp, scattered)) return false;
+
+    setRay(b, slot, ray(p, scattered));
+    b.throughput[slot] = b.throughput[slot] * attenuation;
+    b.rouletteThroughput[slot] =
+        b.rouletteThroughput[slot] * roulette_attenuation(b.tex[slot]);
+    auto nee = sample_next_event(s, world, mat.tag, p, normal, scattered,
+                                 r.time, smp, noise);
+    b.accum[b.pixel[slot]] += b.throughput[slot] * nee.direct;
+    b.bouncePdf[slot] = nee.bouncePdf;
+    return --b.depth[slot] > 0 && survives(s, smp, b, slot);
+}
+
+void wavefrontTile(settings const &s, camera const &cam,
+                   hittable_list const &world, tile const &t, color *pixels,
+                   wavefront_buffers &b, perlin const &noise) {
+    ZoneScopedN("wavefront tile");
+    auto const smp = make_sampler(s);
+    auto const width = t.x1 - t.x0;
+    auto const tilePixels = width * (t.y1 - t.y0);
+    std::fill(b.accum.begin(), b.accum.begin() + tilePixels, color(0, 0, 0));
+
+    auto const paths = tilePixels * s.samples_per_pixel;
+    auto const slots = int(b.pixel.size());
+    int next = 0;
+
+    b.alive.clear();
+    for (int slot = 0; slot < slots && next < paths; ++slot) {
+        generate(s, cam, b, slot, t, next++);
+        b.alive.emplace_back(slot);
+    }
+
+    while (!b.alive.empty()) {
+        intersect(world, b);
+        sortByKey(b);
+
+        auto count = int(b.alive.size());
+        b.alive.clear();
+        {
+            ZoneScopedN("wavefront shade");
+            for (auto slot : std::span(b.queue.data(), count)) {
+                rng::current() = b.rng[slot];
+                bool const alive = shade(s, world, smp, b, slot, noise);
+                b.rng[slot] = rng::current();
+                if (alive) {
+                    b.alive.emplace_back(slot);
+                } else if (next < paths) {
+                    // regenerate: the slot is free for a new camera sample.
+                    generate(s, cam, b, slot, t, next++);
+                    b.alive.emplace_back(slot);
+                }
+            }
+        }
+    }
+
+    for (int p = 0; p < tilePixels; ++p) {
+        auto const i = t.x0 + p % width;
+        auto const j = t.y0 + p / width;
+        pixels[j * s.image_width + i] = b.accum[p] / s.samples_per_pixel;
+    }
+}
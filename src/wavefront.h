@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+
+#include "camera.h"
+#include "hittable_list.h"
+#include "perlin.h"
+#include "random.h"
+#include "scheduler.h"
+#include "settings.h"
+
+// State of the wavefront pipeline. Every path in flight owns a slot in these
+// SoA arrays. Slots are refilled with new camera samples as paths die, so the
+// stages always work on big batches.
+struct wavefront_buffers {
+    // Current ray of each path.
+    std::vector<real> ox, oy, oz;
+    std::vector<real> dx, dy, dz;
+    std::vector<real> time;
+
+    std::vector<color> throughput;
+    // What russian roulette decides on, the same estimate as the deferred
+    // renderer's (see roulette_attenuation).
+    std::vector<color> rouletteThroughput;
+    std::vector<int> pixel;  // in the tile, row by row
+    std::vector<int> depth;  // bounces left
+    // Density of the last bounce if it was lambertian (see geometrySim).
+    std::vector<real> bouncePdf;
+    // Random stream of each path, swapped into rng::current() around the
+    // stages that draw numbers.
+    std::vector<rng::stream> rng;
+
+    // Output of the intersect stage.
+    std::vector<geometry_ptr> hitGeom;
+    std::vector<real> hitT;
+    std::vector<color const *> medium;  // set if the path scatters in a medium
+    std::vector<texture const *> tex;   // checker-resolved texture at the hit
+
+    // Slots to process on each stage, and the shading order.
+    std::vector<int> alive;
+    std::vector<int> keys;
+    std::vector<int> queue;
+
+    std::vector<color> accum;  // per pixel of the tile
+
+    // @perf ~160 bytes per path. 4096 paths keeps the whole state in L2.
+    static constexpr int default_paths = 4096;
+
+    // For tiles of up to tile_size x tile_size pixels.
+    static wavefront_buffers request(int paths, int tile_size);
+};
+
+// Renders tile `t` by stages instead of path by path: generate, intersect,
+// shade (sorted by material and texture kind) and regenerate. All the paths
+// of the tile share the slots, so they stay full across its rows.
+void wavefrontTile(settings const &s, camera const &cam,
+                   hittable_list const &world, tile const &t, color *pixels,
+                   wavefront_buffers &buffers, perlin const &noise);
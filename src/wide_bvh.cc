@@ -0,0 +1,294 @@
+#include "wide_bvh.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <tracy/Tracy.hpp>
+
+#include "hittable.h"
+#include "stats.h"
+#include "trace_colors.h"
+
+namespace bvh {
+
+static bool isLeaf(tree_view const &bld, int node) {
+    return bld.nodes[node].objectIndex != -1;
+}
+
+// Children of an inner node. The left child is right after its parent
+// (pre-order), and the right one starts where the left subtree ends.
+static std::pair<int, int> children(tree_view const &bld, int node) {
+    return {node + 1, bld.node_ends[node + 1]};
+}
+
+// Sorts the children by how far along the octant's diagonal their centroids
+// are, which is a good guess of the order in which a ray in that octant
+// reaches them.
+static uint8_t visitOrder(point3 const *centroids, int count, int octant) {
+    vec3 dir(octant & 1 ? -1 : 1, octant & 2 ? -1 : 1, octant & 4 ? -1 : 1);
+    int slots[wide_node::width] = {0, 1, 2, 3};
+    std::sort(slots, slots + count, [&](int a, int b) {
+        return dot(centroids[a], dir) < dot(centroids[b], dir);
+    });
+    uint8_t packed = 0;
+    for (int i = 0; i < count; ++i) packed |= slots[i] << (2 * i);
+    return packed;
+}
+
+static void setChild(wide_node &wn, int slot, aabb const &box, int first,
+                     int count) {
+    wn.minx[slot] = box.min.x();
+    wn.miny[slot] = box.min.y();
+    wn.minz[slot] = box.min.z();
+    wn.maxx[slot] = box.max.x();
+    wn.maxy[slot] = box.max.y();
+    wn.maxz[slot] = box.max.z();
+    wn.first[slot] = first;
+    wn.count[slot] = count;
+}
+
+static void setOrder(wide_node &wn, point3 const *centroids) {
+    for (int octant = 0; octant < 8; ++octant) {
+        wn.order[octant] = visitOrder(centroids, wn.childCount, octant);
+    }
+}
+
+static aabb bounds(wide_node const &wn) {
+    aabb box = empty_aabb;
+    for (int i = 0; i < wn.childCount; ++i) {
+        box = aabb(box, aabb(point3(wn.minx[i], wn.miny[i], wn.minz[i]),
+                             point3(wn.maxx[i], wn.maxy[i], wn.maxz[i])));
+    }
+    return box;
+}
+
+// `level` is the depth of the new node, 1 for a root.
+static int collapseNode(wide_tree &out, tree_view const &bld,
+                        geometry_arrays const &arrays, int node, int level) {
+    int slots[wide_node::width];
+    int n = 0;
+    if (isLeaf(bld, node)) {
+        slots[n++] = node;
+    } else {
+        auto [left, right] = children(bld, node);
+        slots[n++] = left;
+        slots[n++] = right;
+    }
+
+    // Open the inner child with the biggest surface area until the node is
+    // full, since it's the one most likely to be hit.
+    while (n < wide_node::width) {
+        int best = -1;
+        real bestArea = -1;
+        for (int i = 0; i < n; ++i) {
+            if (isLeaf(bld, slots[i])) continue;
+            auto area = bld.boxes[slots[i]].surface_area();
+            if (area > bestArea) {
+                best = i;
+                bestArea = area;
+            }
+        }
+        if (best == -1) break;
+        auto [left, right] = children(bld, slots[best]);
+        slots[best] = left;
+        slots[n++] = right;
+    }
+
+    // NOTE: recurring may reallocate `out.nodes`, so the node is filled on
+    // the stack and written back at the end.
+    auto index = int(out.nodes.size());
+    out.nodes.emplace_back();
+    out.depth = std::max(out.depth, level);
+
+    wide_node wn{};
+    wn.childCount = n;
+    point3 centroids[wide_node::width];
+    for (int i = 0; i < n; ++i) {
+        auto const &box = bld.boxes[slots[i]];
+        centroids[i] = box.min + 0.5 * (box.max - box.min);
+
+        auto const &child = bld.nodes[slots[i]];
+        if (child.objectIndex != -1) {
+            setChild(wn, i, box, arrays.nodeLeaves[slots[i]],
+                     child.objectCount);
+        } else {
+            setChild(wn, i, box,
+                     collapseNode(out, bld, arrays, slots[i], level + 1), 0);
+        }
+    }
+    setOrder(wn, centroids);
+
+    out.nodes[index] = wn;
+    return index;
+}
+
+wide_tree wide_tree::collapse(tree_view const &bld,
+                              geometry_arrays const &arrays) {
+    ZoneScopedN("wide bvh collapse");
+    wide_tree out;
+    // the binary tree may have several roots, one after the other (e.g. one
+    // per mesh).
+    std::vector<int> roots;
+    for (int root = 0; root < int(bld.nodes.size());
+         root = bld.node_ends[root]) {
+        roots.emplace_back(collapseNode(out, bld, arrays, root, 1));
+    }
+
+    // Put them under new nodes, 4 at a time, until a single one is left.
+    // Each round adds a level above every root.
+    while (roots.size() > 1) {
+        std::vector<int> parents;
+        for (size_t first = 0; first < roots.size();
+             first += wide_node::width) {
+            wide_node wn{};
+            wn.childCount = int(std::min(size_t(wide_node::width),
+                                         roots.size() - first));
+            point3 centroids[wide_node::width];
+            for (int i = 0; i < wn.childCount; ++i) {
+                auto child = roots[first + i];
+                auto box = bounds(out.nodes[child]);
+                centroids[i] = box.min + 0.5 * (box.max - box.min);
+                setChild(wn, i, box, child, 0);
+            }
+            setOrder(wn, centroids);
+            parents.emplace_back(int(out.nodes.size()));
+            out.nodes.emplace_back(wn);
+        }
+        roots = std::move(parents);
+        ++out.depth;
+    }
+    if (!roots.empty()) out.root = roots[0];
+    return out;
+}
+
+std::pair<geometry_ptr, real> wide_tree::hitBVH(
+    geometry_arrays const &arrays, timed_ray const &r,
+    real closestHit) const noexcept {
+    ZoneNamedN(zone, "wide bvh hit", filters::treeHit);
+    geometry_ptr result = nullptr;
+
+    auto const ox = simd::broadcast(r.r.orig.x());
+    auto const oy = simd::broadcast(r.r.orig.y());
+    auto const oz = simd::broadcast(r.r.orig.z());
+    auto const idx = simd::broadcast(1 / r.r.dir.x());
+    auto const idy = simd::broadcast(1 / r.r.dir.y());
+    auto const idz = simd::broadcast(1 / r.r.dir.z());
+    auto const tmin = simd::broadcast(minRayDist);
+
+    int const octant = (r.r.dir.x() < 0) | (r.r.dir.y() < 0) << 1 |
+                       (r.r.dir.z() < 0) << 2;
+
+    struct entry {
+        real tnear;
+        int first;
+        int count;
+    };
+    // Big enough for any traversable() tree, see maxDepth.
+    assert(traversable());
+    entry stack[stackSize];
+    int top = 0;
+    if (!empty()) stack[top++] = {minRayDist, root, 0};
+
+    while (top > 0) {
+        auto const e = stack[--top];
+        // something closer was found after pushing this one.
+        if (e.tnear > closestHit) continue;
+
+        if (e.count != 0) {
+            std::tie(result, closestHit) =
+                arrays.hit(e.first, r, result, closestHit);
+            continue;
+        }
+
+        auto const &n = nodes[e.first];
+        RTWK_COUNT(nodesVisited, 1);
+
+        auto tx0 = (simd::load(n.minx) - ox) * idx;
+        auto tx1 = (simd::load(n.maxx) - ox) * idx;
+        auto ty0 = (simd::load(n.miny) - oy) * idy;
+        auto ty1 = (simd::load(n.maxy) - oy) * idy;
+        auto tz0 = (simd::load(n.minz) - oz) * idz;
+        auto tz1 = (simd::load(n.maxz) - oz) * idz;
+
+        auto tnear =
+            simd::max(simd::max(simd::min(tx0, tx1), simd::min(ty0, ty1)),
+                      simd::max(simd::min(tz0, tz1), tmin));
+        auto tfar = simd::min(
+            simd::min(simd::max(tx0, tx1), simd::max(ty0, ty1)),
+            simd::min(simd::max(tz0, tz1), simd::broadcast(closestHit)));
+
+        auto hits = simd::bits(simd::less_eq(tnear, tfar)) &
+                    ((1 << n.childCount) - 1);
+        if (!hits) continue;
+
+        alignas(32) real tnears[wide_node::width];
+        simd::store(tnears, tnear);
+
+        // Push in reverse visit order so that the nearest child is popped
+        // first.
+        auto order = n.order[octant];
+        for (int i = n.childCount - 1; i >= 0; --i) {
+            int slot = (order >> (2 * i)) & 3;
+            if (!((hits >> slot) & 1)) continue;
+            assert(top < stackSize);
+            stack[top++] = {tnears[slot], n.first[slot], n.count[slot]};
+        }
+    }
+
+    return {result, closestHit};
+}
+
+bool wide_tree::occluded(geometry_arrays const &arrays, timed_ray const &r,
+                         real const maxT) const noexcept {
+    ZoneNamedN(zone, "wide bvh occluded", filters::treeHit);
+
+    // NOTE: @cutnpaste from hitBVH, without the visit order.
+    auto const ox = simd::broadcast(r.r.orig.x());
+    auto const oy = simd::broadcast(r.r.orig.y());
+    auto const oz = simd::broadcast(r.r.orig.z());
+    auto const idx = simd::broadcast(1 / r.r.dir.x());
+    auto const idy = simd::broadcast(1 / r.r.dir.y());
+    auto const idz = simd::broadcast(1 / r.r.dir.z());
+    auto const tmin = simd::broadcast(minRayDist);
+    auto const tmax = simd::broadcast(maxT);
+
+    // Only inner nodes are pushed.
+    assert(traversable());
+    int stack[stackSize];
+    int top = 0;
+    if (!empty()) stack[top++] = root;
+
+    while (top > 0) {
+        auto const &n = nodes[stack[--top]];
+        RTWK_COUNT(nodesVisited, 1);
+
+        auto tx0 = (simd::load(n.minx) - ox) * idx;
+        auto tx1 = (simd::load(n.maxx) - ox) * idx;
+        auto ty0 = (simd::load(n.miny) - oy) * idy;
+        auto ty1 = (simd::load(n.maxy) - oy) * idy;
+        auto tz0 = (simd::load(n.minz) - oz) * idz;
+        auto tz1 = (simd::load(n.maxz) - oz) * idz;
+
+        auto tnear =
+            simd::max(simd::max(simd::min(tx0, tx1), simd::min(ty0, ty1)),
+                      simd::max(simd::min(tz0, tz1), tmin));
+        auto tfar =
+            simd::min(simd::min(simd::max(tx0, tx1), simd::max(ty0, ty1)),
+                      simd::min(simd::max(tz0, tz1), tmax));
+
+        auto hits = simd::bits(simd::less_eq(tnear, tfar)) &
+                    ((1 << n.childCount) - 1);
+        for (; hits; hits &= hits - 1) {
+            int slot = std::countr_zero(unsigned(hits));
+            if (n.count[slot] == 0) {
+                assert(top < stackSize);
+                stack[top++] = n.first[slot];
+            } else if (arrays.occluded(n.first[slot], r, maxT)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+}  // namespace bvh
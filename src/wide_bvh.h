@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "bvh.h"
+#include "geometry.h"
+#include "geometry_arrays.h"
+#include "simd.h"
+
+namespace bvh {
+
+// Node of the collapsed (QBVH) tree. Stores the bounds of up to 4 children as
+// SoA lanes, so that all of them are tested with a single sequence of AVX2
+// instructions.
+struct wide_node {
+    static constexpr int width = simd::width;
+
+    alignas(32) real minx[width];
+    real miny[width];
+    real minz[width];
+    real maxx[width];
+    real maxy[width];
+    real maxz[width];
+
+    // If count[i] == 0, then first[i] is the index of a wide node.
+    // Otherwise first[i] is a leaf of geometry_arrays with count[i] objects.
+    int first[width];
+    int count[width];
+
+    int childCount;
+
+    // Visit order of the children for each ray direction octant (sign bits
+    // of x, y, z). Two bits per child, first to visit in the lowest bits.
+    uint8_t order[8];
+};
+
+struct wide_tree {
+    // Entries of the traversal stack. Each level of the tree adds at most 3
+    // (a node is popped and its 4 children pushed), so trees deeper than
+    // maxDepth can't be traversed.
+    static constexpr int stackSize = 256;
+    static constexpr int maxDepth = (stackSize - 1) / 3;
+
+    std::vector<wide_node> nodes;
+    int root = -1;
+    // Wide levels on the longest path from the root to a leaf.
+    int depth = 0;
+
+    constexpr bool empty() const { return root < 0; }
+    constexpr bool traversable() const { return depth <= maxDepth; }
+
+    // Collapses every root of the binary tree into wide nodes, which are
+    // then put under a single root. `arrays` must be built from the same
+    // tree, and the leaves index them, so the queries take them too. They
+    // aren't stored so that copies of the owner don't point into the
+    // original.
+    static wide_tree collapse(tree_view const &bld,
+                              geometry_arrays const &arrays);
+
+    std::pair<geometry_ptr, real> hitBVH(geometry_arrays const &,
+                                         timed_ray const &,
+                                         real) const noexcept
+        __attribute__((pure));
+    // Whether anything is hit in [minRayDist, maxT). Children are visited
+    // in any order and leaves are tested as soon as their parent is, since
+    // the first hit found ends the query.
+    bool occluded(geometry_arrays const &, timed_ray const &,
+                  real maxT) const noexcept __attribute__((pure));
+};
+
+}  // namespace bvh